@@ -0,0 +1,90 @@
+// satnow: boundedqueue.hh
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __SATNOW_BOUNDEDQUEUE_HH
+#define __SATNOW_BOUNDEDQUEUE_HH
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+// A FIFO queue holding at most a fixed number of items, for handing work
+// from one thread to another. A producer that gets ahead waits for room, so
+// the memory held between two stages stays bounded. The queue counts how
+// often each side had to wait, which tells which side is the bottleneck.
+template <typename T> class BoundedQueue {
+private:
+  std::mutex _lock;
+  std::condition_variable _notFull, _notEmpty;
+  std::deque<T> _items;
+  const size_t _capacity;
+  bool _closed;
+  size_t _fullWaits;  // Times push() found the queue full.
+  size_t _emptyWaits; // Times pop() found the queue empty.
+
+public:
+  explicit BoundedQueue(size_t capacity)
+      : _capacity(std::max<size_t>(capacity, 1)), _closed(false),
+        _fullWaits(0), _emptyWaits(0) {}
+  BoundedQueue(const BoundedQueue &) = delete;
+  BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+  // Append 'item', waiting while the queue is full.
+  void push(T item) {
+    std::unique_lock<std::mutex> lk(_lock);
+    if (_items.size() >= _capacity) {
+      ++_fullWaits;
+      _notFull.wait(lk, [this] { return _items.size() < _capacity; });
+    }
+    _items.push_back(std::move(item));
+    _notEmpty.notify_one();
+  }
+
+  // Take the oldest item, waiting while the queue is empty. Returns false
+  // once the queue is closed and everything in it has been taken.
+  bool pop(T &item) {
+    std::unique_lock<std::mutex> lk(_lock);
+    if (_items.empty() && !_closed) {
+      ++_emptyWaits;
+      _notEmpty.wait(lk, [this] { return !_items.empty() || _closed; });
+    }
+    if (_items.empty())
+      return false;
+    item = std::move(_items.front());
+    _items.pop_front();
+    _notFull.notify_one();
+    return true;
+  }
+
+  // No more items will be pushed.
+  void close() {
+    std::lock_guard<std::mutex> lk(_lock);
+    _closed = true;
+    _notEmpty.notify_all();
+  }
+
+  size_t fullWaits() {
+    std::lock_guard<std::mutex> lk(_lock);
+    return _fullWaits;
+  }
+  size_t emptyWaits() {
+    std::lock_guard<std::mutex> lk(_lock);
+    return _emptyWaits;
+  }
+};
+
+#endif // __SATNOW_BOUNDEDQUEUE_HH
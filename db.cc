@@ -15,38 +15,316 @@
 // limitations under the License.
 
 #include "db.hh"
+#include <DateTime.h>
+#include <Globals.h>
+#include <algorithm>
+#include <iostream>
 
-std::vector<Tle> DBSQLite::fetchTLEs() {
-  std::vector<Tle> tles;
-  const char *q = "SELECT name, line1, line2 FROM tle;";
-  auto cb = [](void *tleptr, int nCols, char **row, char **colName) {
-    auto tles = static_cast<std::vector<Tle> *>(tleptr);
-    if (nCols != 3)
-      return SQLITE_OK;
-    std::string name(row[0]);
-    std::string line1(row[1]);
-    std::string line2(row[2]);
-    if (name.size())
-      tles->emplace_back(name, line1, line2);
-    else
-      tles->emplace_back(name, line1, line2);
-    return SQLITE_OK;
+std::string TleFilter::likePattern() const {
+  std::string like;
+  bool wildcards = false;
+  for (const char c : name) {
+    if (c == '*' || c == '?') {
+      like += c == '*' ? '%' : '_';
+      wildcards = true;
+      continue;
+    }
+    if (c == '%' || c == '_' || c == '\\')
+      like += '\\';
+    like += c;
+  }
+  return wildcards ? like : '%' + like + '%';
+}
+
+std::vector<TleRecord> DB::fetchTLEs(const TleFilter &filter) {
+  std::vector<TleRecord> tles;
+  forEachTLE([&tles](const TleRecord &tle) { tles.push_back(tle); }, filter);
+  return tles;
+}
+
+// Prepare "SELECT 'columns' FROM tle" for the rows matching 'filter'.
+// Returns nullptr (after reporting why) on error.
+// Only the predicates that narrow the selection are added, so that SQLite
+// picks the index of a column that is actually constrained.
+sqlite3_stmt *DBSQLite::prepareSelect(const char *columns,
+                                      const TleFilter &filter) {
+  std::string q = std::string("SELECT ") + columns + " FROM tle";
+  const char *sep = " WHERE ";
+  auto where = [&q, &sep](const char *predicate) {
+    q += sep;
+    q += predicate;
+    sep = " AND ";
   };
+  if (!filter.name.empty())
+    where("name LIKE ? ESCAPE '\\'");
+  if (filter.minNorad > 0)
+    where("norad >= ?");
+  if (filter.maxNorad < UINT32_MAX)
+    where("norad <= ?");
+  if (filter.maxPeriod > 0.0)
+    where("period <= ?");
+  if (filter.minInclination > 0.0)
+    where("inclination >= ?");
+  if (filter.maxEpochAge > 0.0)
+    where("epoch >= ?");
+  q += ';';
 
-  if (sqlite3_exec(_sql, q, cb, &tles, nullptr)) {
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(_sql, q.c_str(), -1, &stmt, nullptr)) {
     std::cerr << "[-] Error querying database: " << sqlite3_errmsg(_sql)
               << std::endl;
-    return tles;
+    return nullptr;
   }
 
-  return tles;
+  // Bind in the same order as the predicates were added.
+  int arg = 0;
+  if (!filter.name.empty())
+    sqlite3_bind_text(stmt, ++arg, filter.likePattern().c_str(), -1,
+                      SQLITE_TRANSIENT);
+  if (filter.minNorad > 0)
+    sqlite3_bind_int64(stmt, ++arg, filter.minNorad);
+  if (filter.maxNorad < UINT32_MAX)
+    sqlite3_bind_int64(stmt, ++arg, filter.maxNorad);
+  if (filter.maxPeriod > 0.0)
+    sqlite3_bind_double(stmt, ++arg, filter.maxPeriod);
+  if (filter.minInclination > 0.0)
+    sqlite3_bind_double(stmt, ++arg, filter.minInclination);
+  if (filter.maxEpochAge > 0.0)
+    sqlite3_bind_int64(
+        stmt, ++arg,
+        DateTime::Now(true).AddDays(-filter.maxEpochAge).Ticks());
+  return stmt;
+}
+
+// Column 'col' of the current row of 'stmt', without copying it.
+static std::string_view columnText(sqlite3_stmt *stmt, int col) {
+  const auto *text =
+      reinterpret_cast<const char *>(sqlite3_column_text(stmt, col));
+  const auto len = static_cast<size_t>(sqlite3_column_bytes(stmt, col));
+  return std::string_view(text ? text : "", len);
+}
+
+// Parse the name, line1 and line2 in columns [col, col + 3) of 'stmt'.
+static bool parseRow(sqlite3_stmt *stmt, int col, TleRecord &rec) {
+  if (sqlite3_column_type(stmt, col + 1) == SQLITE_NULL ||
+      sqlite3_column_type(stmt, col + 2) == SQLITE_NULL)
+    return false;
+  return TleRecord::parse(columnText(stmt, col), columnText(stmt, col + 1),
+                          columnText(stmt, col + 2), rec);
+}
+
+// Rows are parsed straight from the column text that SQLite hands back, so no
+// strings are copied on the way to the record.
+size_t DBSQLite::forEachTLE(
+    const std::function<void(const TleRecord &)> &visit,
+    const TleFilter &filter) {
+  sqlite3_stmt *stmt = prepareSelect("name, line1, line2", filter);
+  if (!stmt)
+    return 0;
+  size_t count = 0;
+  int rc;
+  TleRecord rec;
+  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    if (parseRow(stmt, 0, rec)) {
+      visit(rec);
+      ++count;
+    }
+  }
+  if (rc != SQLITE_DONE)
+    std::cerr << "[-] Error querying database: " << sqlite3_errmsg(_sql)
+              << std::endl;
+  sqlite3_finalize(stmt);
+  return count;
+}
+
+// For each satellite, look up the last element set at or before 'when' and
+// the first one after it. Both are a seek on the (norad, epoch) key of
+// tle_history, so the cost per satellite does not grow with the history.
+size_t DBSQLite::forEachTLEAt(
+    int64_t when, const std::function<void(const TleRecord &)> &visit,
+    const TleFilter &filter) {
+  const char *qBefore = "SELECT epoch, name, line1, line2 FROM tle_history "
+                        "WHERE norad = ? AND epoch <= ? "
+                        "ORDER BY epoch DESC LIMIT 1;";
+  const char *qAfter = "SELECT epoch, name, line1, line2 FROM tle_history "
+                       "WHERE norad = ? AND epoch > ? "
+                       "ORDER BY epoch LIMIT 1;";
+  sqlite3_stmt *before = nullptr, *after = nullptr;
+  if (sqlite3_prepare_v2(_sql, qBefore, -1, &before, nullptr) ||
+      sqlite3_prepare_v2(_sql, qAfter, -1, &after, nullptr)) {
+    std::cerr << "[-] Error querying history: " << sqlite3_errmsg(_sql)
+              << std::endl;
+    sqlite3_finalize(before);
+    return 0;
+  }
+  sqlite3_stmt *stmt = prepareSelect("norad, name, line1, line2", filter);
+  if (!stmt) {
+    sqlite3_finalize(before);
+    sqlite3_finalize(after);
+    return 0;
+  }
+
+  // Step 'probe' for 'norad', and return its distance from 'when' (or -1 if
+  // there is no such element set).
+  auto seek = [when](sqlite3_stmt *probe, sqlite3_int64 norad) -> int64_t {
+    sqlite3_reset(probe);
+    sqlite3_bind_int64(probe, 1, norad);
+    sqlite3_bind_int64(probe, 2, when);
+    if (sqlite3_step(probe) != SQLITE_ROW)
+      return -1;
+    const int64_t epoch = sqlite3_column_int64(probe, 0);
+    return epoch > when ? epoch - when : when - epoch;
+  };
+
+  size_t count = 0;
+  int rc;
+  TleRecord rec;
+  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    const sqlite3_int64 norad = sqlite3_column_int64(stmt, 0);
+    const int64_t dBefore = seek(before, norad);
+    const int64_t dAfter = seek(after, norad);
+    // Without any history (e.g. no epoch was stored), use the current set.
+    sqlite3_stmt *row = stmt;
+    if (dBefore >= 0 && (dAfter < 0 || dBefore <= dAfter))
+      row = before;
+    else if (dAfter >= 0)
+      row = after;
+    if (parseRow(row, 1, rec)) {
+      visit(rec);
+      ++count;
+    }
+  }
+  if (rc != SQLITE_DONE)
+    std::cerr << "[-] Error querying database: " << sqlite3_errmsg(_sql)
+              << std::endl;
+  sqlite3_finalize(stmt);
+  sqlite3_finalize(before);
+  sqlite3_finalize(after);
+  return count;
+}
+
+// One statement is prepared and rebound for every record. Without an explicit
+// transaction SQLite commits (and syncs) each row on its own, so the rows are
+// grouped into transactions of 'batchSize'. Returns the number of rows that
+// were changed.
+size_t DBSQLite::writeMany(
+    const char *q, const TleRecord *tles, size_t count, size_t batchSize,
+    void (*bind)(sqlite3_stmt *stmt, const TleRecord &tle)) {
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(_sql, q, -1, &stmt, nullptr)) {
+    std::cerr << "[-] Error preparing update: " << sqlite3_errmsg(_sql)
+              << std::endl;
+    return 0;
+  }
+
+  batchSize = std::max<size_t>(batchSize, 1);
+  size_t written = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (i % batchSize == 0 &&
+        sqlite3_exec(_sql, "BEGIN;", nullptr, nullptr, nullptr))
+      break;
+    const TleRecord &tle = tles[i];
+    bind(stmt, tle);
+    if (sqlite3_step(stmt) == SQLITE_DONE)
+      written += sqlite3_changes(_sql);
+    else
+      std::cerr << "[-] Error storing TLE " << tle.norad << " (" << tle.name
+                << "): " << sqlite3_errmsg(_sql) << std::endl;
+    sqlite3_reset(stmt);
+    if ((i + 1) % batchSize == 0 || i + 1 == count)
+      sqlite3_exec(_sql, "COMMIT;", nullptr, nullptr, nullptr);
+  }
+  sqlite3_finalize(stmt);
+  return written;
+}
+
+// The tle_history trigger archives each row as it is written.
+size_t DBSQLite::updateMany(const TleRecord *tles, size_t count,
+                            size_t batchSize) {
+  const char *q = "INSERT OR REPLACE INTO tle "
+                  "(name, norad, line1, line2, epoch, inclination, period) "
+                  "VALUES (?, ?, ?, ?, ?, ?, ?);";
+  return writeMany(q, tles, count, batchSize,
+                   [](sqlite3_stmt *stmt, const TleRecord &tle) {
+                     sqlite3_bind_text(stmt, 1, tle.name, -1, SQLITE_STATIC);
+                     sqlite3_bind_int64(stmt, 2, tle.norad);
+                     sqlite3_bind_text(stmt, 3, tle.line1, -1, SQLITE_STATIC);
+                     sqlite3_bind_text(stmt, 4, tle.line2, -1, SQLITE_STATIC);
+                     sqlite3_bind_int64(stmt, 5, tle.epoch);
+                     sqlite3_bind_double(stmt, 6, tle.inclination);
+                     sqlite3_bind_double(stmt, 7,
+                                         kMINUTES_PER_DAY / tle.meanMotion);
+                   });
+}
+
+size_t DBSQLite::archiveMany(const TleRecord *tles, size_t count,
+                             size_t batchSize) {
+  const char *q = "INSERT OR IGNORE INTO tle_history "
+                  "(norad, epoch, name, line1, line2) VALUES (?, ?, ?, ?, ?);";
+  return writeMany(q, tles, count, batchSize,
+                   [](sqlite3_stmt *stmt, const TleRecord &tle) {
+                     sqlite3_bind_int64(stmt, 1, tle.norad);
+                     sqlite3_bind_int64(stmt, 2, tle.epoch);
+                     sqlite3_bind_text(stmt, 3, tle.name, -1, SQLITE_STATIC);
+                     sqlite3_bind_text(stmt, 4, tle.line1, -1, SQLITE_STATIC);
+                     sqlite3_bind_text(stmt, 5, tle.line2, -1, SQLITE_STATIC);
+                   });
+}
+
+size_t DBSQLite::forEachEpoch(
+    const std::function<void(uint32_t norad, int64_t epoch)> &visit) {
+  const char *q = "SELECT norad, epoch FROM tle WHERE epoch IS NOT NULL;";
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(_sql, q, -1, &stmt, nullptr)) {
+    std::cerr << "[-] Error querying database: " << sqlite3_errmsg(_sql)
+              << std::endl;
+    return 0;
+  }
+  size_t count = 0;
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    visit(static_cast<uint32_t>(sqlite3_column_int64(stmt, 0)),
+          sqlite3_column_int64(stmt, 1));
+    ++count;
+  }
+  sqlite3_finalize(stmt);
+  return count;
 }
 
-void DBSQLite::update(const Tle &tle) {
-  std::string q = "INSERT OR REPLACE INTO tle (name, norad, line1, line2) ";
-  q += "VALUES (\'" + tle.Name() + "\', " + std::to_string(tle.NoradNumber()) +
-       ", \"" + tle.Line1() + "\", \"" + tle.Line2() + "\");";
-  sqlite3_exec(_sql, q.c_str(), nullptr, nullptr, nullptr);
+bool DBSQLite::getSource(const std::string &source, SourceState &state) {
+  const char *q = "SELECT etag, last_modified, hash FROM source WHERE url = ?;";
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(_sql, q, -1, &stmt, nullptr))
+    return false;
+  sqlite3_bind_text(stmt, 1, source.c_str(), -1, SQLITE_TRANSIENT);
+  const bool found = sqlite3_step(stmt) == SQLITE_ROW;
+  if (found) {
+    auto text = [stmt](int col) {
+      const auto *str = sqlite3_column_text(stmt, col);
+      return str ? std::string(reinterpret_cast<const char *>(str))
+                 : std::string();
+    };
+    state.etag = text(0);
+    state.lastModified = text(1);
+    state.hash = static_cast<uint64_t>(sqlite3_column_int64(stmt, 2));
+  }
+  sqlite3_finalize(stmt);
+  return found;
+}
+
+void DBSQLite::updateSource(const std::string &source,
+                            const SourceState &state) {
+  const char *q = "INSERT OR REPLACE INTO source "
+                  "(url, etag, last_modified, hash) VALUES (?, ?, ?, ?);";
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(_sql, q, -1, &stmt, nullptr))
+    return;
+  sqlite3_bind_text(stmt, 1, source.c_str(), -1, SQLITE_TRANSIENT);
+  sqlite3_bind_text(stmt, 2, state.etag.c_str(), -1, SQLITE_TRANSIENT);
+  sqlite3_bind_text(stmt, 3, state.lastModified.c_str(), -1,
+                    SQLITE_TRANSIENT);
+  sqlite3_bind_int64(stmt, 4, static_cast<sqlite3_int64>(state.hash));
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
 }
 
 DBSQLite::DBSQLite(const char *dbFile) {
@@ -55,11 +333,101 @@ DBSQLite::DBSQLite(const char *dbFile) {
     const char *q = "CREATE TABLE IF NOT EXISTS tle "
                     "(timestamp TIMESTAMP DEFAULT CURRENT_TIMESTAMP, "
                     "norad INT PRIMARY KEY, "
-                    "name TEXT, line1 TEXT, line2 TEXT)";
+                    "name TEXT, line1 TEXT, line2 TEXT, "
+                    "epoch INT, inclination REAL, period REAL);"
+                    "CREATE TABLE IF NOT EXISTS source "
+                    "(timestamp TIMESTAMP DEFAULT CURRENT_TIMESTAMP, "
+                    "url TEXT PRIMARY KEY, etag TEXT, last_modified TEXT, "
+                    "hash INT)";
     sqlite3_exec(_sql, q, nullptr, nullptr, nullptr);
+    addElementColumns();
+
+    // Count every change to the tle table. INSERT OR REPLACE only fires the
+    // insert trigger, which is all it needs to.
+    q = "CREATE TABLE IF NOT EXISTS meta (key TEXT PRIMARY KEY, value INT);"
+        "INSERT OR IGNORE INTO meta (key, value) VALUES ('generation', 0);"
+        "CREATE TRIGGER IF NOT EXISTS tle_insert AFTER INSERT ON tle BEGIN "
+        "UPDATE meta SET value = value + 1 WHERE key = 'generation'; END;"
+        "CREATE TRIGGER IF NOT EXISTS tle_update AFTER UPDATE ON tle BEGIN "
+        "UPDATE meta SET value = value + 1 WHERE key = 'generation'; END;"
+        "CREATE TRIGGER IF NOT EXISTS tle_delete AFTER DELETE ON tle BEGIN "
+        "UPDATE meta SET value = value + 1 WHERE key = 'generation'; END;";
+    sqlite3_exec(_sql, q, nullptr, nullptr, nullptr);
+    addHistory();
   }
 }
 
+uint64_t DBSQLite::generation() {
+  const char *q = "SELECT value FROM meta WHERE key = 'generation';";
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(_sql, q, -1, &stmt, nullptr))
+    return 0;
+  uint64_t gen = 0;
+  if (sqlite3_step(stmt) == SQLITE_ROW)
+    gen = static_cast<uint64_t>(sqlite3_column_int64(stmt, 0));
+  sqlite3_finalize(stmt);
+  return gen;
+}
+
+// The element columns that TleFilter selects on were added after the tle
+// table. Add them to a database that predates them, and fill them in from
+// the stored lines.
+void DBSQLite::addElementColumns() {
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(_sql, "SELECT epoch FROM tle LIMIT 0;", -1, &stmt,
+                         nullptr) == SQLITE_OK) {
+    sqlite3_finalize(stmt);
+  } else {
+    const char *q = "ALTER TABLE tle ADD COLUMN epoch INT;"
+                    "ALTER TABLE tle ADD COLUMN inclination REAL;"
+                    "ALTER TABLE tle ADD COLUMN period REAL;";
+    if (sqlite3_exec(_sql, q, nullptr, nullptr, nullptr))
+      return;
+    std::vector<TleRecord> tles = fetchTLEs();
+    updateMany(tles.data(), tles.size());
+    std::cout << "[+] Added element columns for " << tles.size()
+              << " stored TLEs" << std::endl;
+  }
+
+  const char *q = "CREATE INDEX IF NOT EXISTS tle_epoch ON tle (epoch);"
+                  "CREATE INDEX IF NOT EXISTS tle_inclination "
+                  "ON tle (inclination);"
+                  "CREATE INDEX IF NOT EXISTS tle_period ON tle (period);";
+  sqlite3_exec(_sql, q, nullptr, nullptr, nullptr);
+}
+
+// Every element set ever stored, keyed (and so ordered) by (norad, epoch).
+// Without a rowid the key is the table's own b-tree, so a lookup by satellite
+// and time is a single seek that finds the whole row there. A trigger copies
+// each TLE written to the tle table; a database that predates the history
+// starts it from the TLEs it has.
+void DBSQLite::addHistory() {
+  sqlite3_stmt *stmt;
+  const bool exists =
+      sqlite3_prepare_v2(_sql, "SELECT epoch FROM tle_history LIMIT 0;", -1,
+                         &stmt, nullptr) == SQLITE_OK;
+  sqlite3_finalize(stmt);
+
+  const char *q =
+      "CREATE TABLE IF NOT EXISTS tle_history "
+      "(norad INT NOT NULL, epoch INT NOT NULL, "
+      "name TEXT, line1 TEXT, line2 TEXT, "
+      "PRIMARY KEY (norad, epoch)) WITHOUT ROWID;"
+      "CREATE TRIGGER IF NOT EXISTS tle_archive AFTER INSERT ON tle "
+      "WHEN NEW.epoch IS NOT NULL BEGIN "
+      "INSERT OR IGNORE INTO tle_history (norad, epoch, name, line1, line2) "
+      "VALUES (NEW.norad, NEW.epoch, NEW.name, NEW.line1, NEW.line2); END;";
+  if (sqlite3_exec(_sql, q, nullptr, nullptr, nullptr) || exists)
+    return;
+  q = "INSERT OR IGNORE INTO tle_history (norad, epoch, name, line1, line2) "
+      "SELECT norad, epoch, name, line1, line2 FROM tle "
+      "WHERE epoch IS NOT NULL;";
+  if (sqlite3_exec(_sql, q, nullptr, nullptr, nullptr) == SQLITE_OK &&
+      sqlite3_changes(_sql) > 0)
+    std::cout << "[+] Started the TLE history with " << sqlite3_changes(_sql)
+              << " stored TLEs" << std::endl;
+}
+
 DBSQLite::~DBSQLite() { sqlite3_close(_sql); }
 
 bool DBSQLite::ok() const { return sqlite3_errcode(_sql) == SQLITE_OK; }
@@ -16,17 +16,88 @@
 
 #ifndef __SATNOW_DB_HH
 #define __SATNOW_DB_HH
-#include <Tle.h>
+#include "tlerecord.hh"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <sqlite3.h>
 #include <string>
 #include <vector>
 
 #define DEFAULT_DB_PATH "./.satnow.sql3"
 
+// What was last fetched from a TLE source (a URL or file), so that an update
+// can tell if the source has changed since.
+struct SourceState {
+  std::string etag;         // HTTP ETag response header.
+  std::string lastModified; // HTTP Last-Modified response header.
+  uint64_t hash = 0;        // Hash of the content (0 if unknown).
+};
+
+// Which TLEs to read from the database. Each field that is set narrows the
+// selection, and is checked by SQLite against columns stored with the record,
+// so satellites that don't match are never read or parsed.
+struct TleFilter {
+  std::string name;               // Name pattern (see likePattern); "": any.
+  uint32_t minNorad = 0;          // Catalog number range.
+  uint32_t maxNorad = UINT32_MAX;
+  double maxPeriod = 0.0;         // Minutes (0: any).
+  double minInclination = 0.0;    // Degrees (0: any).
+  double maxEpochAge = 0.0;       // Days before now (0: any).
+
+  // True if no field is set, so every TLE is selected.
+  bool selectsAll() const {
+    return name.empty() && minNorad == 0 && maxNorad == UINT32_MAX &&
+           maxPeriod <= 0.0 && minInclination <= 0.0 && maxEpochAge <= 0.0;
+  }
+
+  // 'name' is case insensitive, and may use '*' (anything) and '?' (any one
+  // character). A name without wildcards matches any name containing it.
+  // Returns the equivalent SQL LIKE pattern (escaped with '\').
+  std::string likePattern() const;
+};
+
 class DB {
 public:
-  virtual std::vector<Tle> fetchTLEs() = 0;
-  virtual void update(const Tle &tle) = 0;
+  // Rows written per transaction by updateMany() unless told otherwise.
+  static constexpr size_t kDefaultBatchSize = 10000;
+
+  // Call 'visit' with each stored TLE as its row is read, without building a
+  // list. The record is only valid during the call. Returns the number of
+  // records visited.
+  // Only records matching 'filter' are visited.
+  virtual size_t
+  forEachTLE(const std::function<void(const TleRecord &)> &visit,
+             const TleFilter &filter = TleFilter()) = 0;
+  std::vector<TleRecord> fetchTLEs(const TleFilter &filter = TleFilter());
+  // As forEachTLE(), but visit the element set of each satellite whose epoch
+  // is closest to 'when' (DateTime ticks), out of all that were ever stored.
+  // 'filter' selects satellites by their current element set.
+  virtual size_t
+  forEachTLEAt(int64_t when,
+               const std::function<void(const TleRecord &)> &visit,
+               const TleFilter &filter = TleFilter()) = 0;
+  // Call 'visit' with the catalog number and epoch (DateTime ticks) of each
+  // stored TLE.
+  virtual size_t forEachEpoch(
+      const std::function<void(uint32_t norad, int64_t epoch)> &visit) = 0;
+  // Insert or replace 'count' records, committing every 'batchSize' rows.
+  // Returns the number of records written.
+  virtual size_t updateMany(const TleRecord *tles, size_t count,
+                            size_t batchSize = kDefaultBatchSize) = 0;
+  void update(const TleRecord &tle) { updateMany(&tle, 1); }
+  // Every record written by updateMany() is also kept in the history. Add
+  // 'count' older records to the history only, committing every 'batchSize'
+  // rows. Returns the number that were not already there.
+  virtual size_t archiveMany(const TleRecord *tles, size_t count,
+                             size_t batchSize = kDefaultBatchSize) = 0;
+  // Returns false if nothing is stored for 'source'.
+  virtual bool getSource(const std::string &source, SourceState &state) = 0;
+  virtual void updateSource(const std::string &source,
+                            const SourceState &state) = 0;
+  // A counter that changes whenever the stored TLEs do, so that data derived
+  // from them (see CatalogSnapshot) can tell if it is out of date.
+  virtual uint64_t generation() = 0;
   virtual bool ok() const = 0;
   virtual std::string getErrorString() const = 0;
 };
@@ -35,12 +106,32 @@ class DBSQLite final : public DB {
 private:
   sqlite3 *_sql;
 
+  void addElementColumns();
+  void addHistory();
+  sqlite3_stmt *prepareSelect(const char *columns, const TleFilter &filter);
+  size_t writeMany(const char *q, const TleRecord *tles, size_t count,
+                   size_t batchSize,
+                   void (*bind)(sqlite3_stmt *stmt, const TleRecord &tle));
+
 public:
   DBSQLite(const char *dbFile);
   virtual ~DBSQLite();
   bool ok() const override final;
-  void update(const Tle &tle) override final;
-  std::vector<Tle> fetchTLEs() override final;
+  size_t updateMany(const TleRecord *tles, size_t count,
+                    size_t batchSize = kDefaultBatchSize) override final;
+  size_t forEachTLE(const std::function<void(const TleRecord &)> &visit,
+                    const TleFilter &filter = TleFilter()) override final;
+  size_t forEachTLEAt(int64_t when,
+                      const std::function<void(const TleRecord &)> &visit,
+                      const TleFilter &filter = TleFilter()) override final;
+  size_t archiveMany(const TleRecord *tles, size_t count,
+                     size_t batchSize = kDefaultBatchSize) override final;
+  size_t forEachEpoch(const std::function<void(uint32_t norad, int64_t epoch)>
+                          &visit) override final;
+  bool getSource(const std::string &source, SourceState &state) override final;
+  void updateSource(const std::string &source,
+                    const SourceState &state) override final;
+  uint64_t generation() override final;
   std::string getErrorString() const override final;
 };
 
@@ -35,7 +35,7 @@ void DisplayConsole::render(SatLookAngles &TLEsAndLAs) {
     const auto &tle = TL.first;
     const auto &la = TL.second;
     std::cout << "[+] [" << (++count) << '/' << nTles << "] " << '('
-              << tle.Name() << "): LookAngle: " << la << std::endl;
+              << tle.name << "): LookAngle: " << la << std::endl;
   }
 }
 
@@ -61,7 +61,7 @@ using std::make_pair;
 
 // Populate the info window with data from 'sat'.
 static void updateInfoWindow(WINDOW *win, const SatLookAngle &sat) {
-  const Tle &tle = sat.first;
+  const Tle tle = sat.first.toTle();
   int curRow = 1;
   if (tle.Name().size() > 0)
     mvwprintw(win, curRow++, 1, "Name : %s", tle.Name().c_str());
@@ -125,14 +125,16 @@ static MENU *updateMenu(MENU *menu, WINDOW *win, SatLookAngles &sats,
 
   // Create the strings (items) for the menu.
   for (size_t i = 0; i < sats.size(); ++i) {
-    const auto &tle = sats[i].first;
-    const auto &la = sats[i].second;
+    const auto sat = sats[i];
+    const auto &tle = sat.first;
+    const auto &la = sat.second;
     std::stringstream ss;
     ss << std::left << std::setw(10) << std::to_string(i) << std::setw(25)
-       << tle.Name() << std::setw(15)
+       << tle.name << std::setw(15)
        << std::to_string(Util::RadiansToDegrees(la.azimuth)) << std::setw(15)
-       << std::to_string(Util::RadiansToDegrees(la.elevation)) << std::setw(12)
-       << std::to_string(la.range);
+       << (std::to_string(Util::RadiansToDegrees(la.elevation)) +
+           (sat.stale ? "*" : ""))
+       << std::setw(12) << std::to_string(la.range);
     itemStrs[i] = ss.str();
     if (items[i])
       free_item(items[i]);
@@ -0,0 +1,164 @@
+// satnow: ephemeris.cc
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ephemeris.hh"
+#include <algorithm>
+#include <cmath>
+
+// Knot spacing limits (seconds).
+static const double kMinStep = 1.0, kMaxStep = 600.0;
+
+// Initial knot spacing as a fraction of the orbital period.
+static const double kKnotsPerOrbit = 16.0;
+
+// Fit one satellite with knot spacing 'h' into 'coeffs'. Returns the largest
+// midpoint error.
+static double fitSatellite(const SGP4 &model, const DateTime &begin,
+                           double spanSecs, double h,
+                           std::vector<double> &coeffs) {
+  const size_t nSegs = static_cast<size_t>(std::ceil(spanSecs / h));
+  Eci prev = model.FindPosition(begin);
+  double maxErr = 0.0;
+  for (size_t seg = 0; seg < nSegs; ++seg) {
+    const Eci next = model.FindPosition(begin.AddSeconds((seg + 1) * h));
+    const Vector &p0 = prev.Position(), &p1 = next.Position();
+    const Vector &v0 = prev.Velocity(), &v1 = next.Velocity();
+    const double a0[3] = {p0.x, p0.y, p0.z}, a1[3] = {p1.x, p1.y, p1.z};
+    const double d0[3] = {v0.x * h, v0.y * h, v0.z * h};
+    const double d1[3] = {v1.x * h, v1.y * h, v1.z * h};
+    double mid[3];
+    for (int axis = 0; axis < 3; ++axis) {
+      const double c0 = a0[axis], c1 = d0[axis];
+      const double c2 = 3.0 * (a1[axis] - a0[axis]) - 2.0 * d0[axis] - d1[axis];
+      const double c3 = 2.0 * (a0[axis] - a1[axis]) + d0[axis] + d1[axis];
+      coeffs.insert(coeffs.end(), {c0, c1, c2, c3});
+      mid[axis] = c0 + 0.5 * (c1 + 0.5 * (c2 + 0.5 * c3));
+    }
+    const Vector exact =
+        model.FindPosition(begin.AddSeconds((seg + 0.5) * h)).Position();
+    const Vector fit(mid[0], mid[1], mid[2]);
+    maxErr = std::max(maxErr, (fit - exact).Magnitude());
+    prev = next;
+  }
+  return maxErr;
+}
+
+double EphemerisSpan::initialStep(const TleRecord &tle) {
+  const double period = 86400.0 / tle.meanMotion;
+  return std::max(kMinStep, std::min(kMaxStep, period / kKnotsPerOrbit));
+}
+
+EphemerisSpan::EphemerisSpan(const std::vector<SGP4> &models,
+                             std::vector<double> &steps, const DateTime &begin,
+                             double spanSecs, double maxErrorKm)
+    : _begin(begin.Ticks()),
+      _end(begin.Ticks() + static_cast<int64_t>(spanSecs * 1e6)) {
+  std::vector<double> coeffs;
+  for (size_t i = 0; i < models.size(); ++i) {
+    _first.push_back(_coeffs.size() / kCoeffs);
+    double h = steps[i];
+    bool fitted = false;
+    try {
+      while (true) {
+        coeffs.clear();
+        const double err = fitSatellite(models[i], begin, spanSecs, h, coeffs);
+        if (err <= maxErrorKm) {
+          fitted = true;
+          break;
+        }
+        if (h <= kMinStep)
+          break; // The bound can't be met; leave it to SGP4.
+        h = std::max(kMinStep, 0.5 * h);
+      }
+      steps[i] = h;
+    } catch (...) {
+      // libsgp4 threw somewhere in the span.
+    }
+    if (fitted)
+      _coeffs.insert(_coeffs.end(), coeffs.begin(), coeffs.end());
+    _steps.push_back(fitted ? h : 0.0);
+  }
+}
+
+EphemerisCache::EphemerisCache(const std::vector<TleRecord> &tles,
+                               double maxErrorKm, double spanMinutes)
+    : _maxError(maxErrorKm), _spanSecs(spanMinutes * 60.0), _request(-1),
+      _fitting(-1), _stop(false) {
+  for (const auto &tle : tles) {
+    _models.emplace_back(tle.toTle());
+    _steps.push_back(EphemerisSpan::initialStep(tle));
+  }
+  _thread = std::thread(&EphemerisCache::run, this);
+}
+
+EphemerisCache::~EphemerisCache() {
+  {
+    std::lock_guard<std::mutex> lk(_lock);
+    _stop = true;
+  }
+  _wake.notify_one();
+  _thread.join();
+}
+
+bool EphemerisCache::pending(int64_t ticks) const {
+  const int64_t span = static_cast<int64_t>(_spanSecs * 1e6);
+  for (const int64_t begin : {_request, _fitting})
+    if (begin >= 0 && ticks >= begin && ticks < begin + span)
+      return true;
+  return false;
+}
+
+std::shared_ptr<const EphemerisSpan>
+EphemerisCache::find(const DateTime &when) {
+  const int64_t ticks = when.Ticks();
+  std::lock_guard<std::mutex> lk(_lock);
+  if ((!_current || !_current->covers(ticks)) && _next &&
+      _next->covers(ticks)) {
+    _current = std::move(_next);
+    _next.reset();
+  }
+  if (_current && _current->covers(ticks)) {
+    // Prefetch the following span.
+    if (!_next && !pending(_current->end())) {
+      _request = _current->end();
+      _wake.notify_one();
+    }
+    return _current;
+  }
+  if (!pending(ticks)) {
+    _request = ticks;
+    _wake.notify_one();
+  }
+  return nullptr;
+}
+
+void EphemerisCache::run() {
+  std::unique_lock<std::mutex> lk(_lock);
+  while (true) {
+    _wake.wait(lk, [this] { return _stop || _request >= 0; });
+    if (_stop)
+      return;
+    _fitting = _request;
+    _request = -1;
+    lk.unlock();
+    // Only this thread touches _models and _steps.
+    auto span = std::make_shared<const EphemerisSpan>(
+        _models, _steps, DateTime(_fitting), _spanSecs, _maxError);
+    lk.lock();
+    _next = std::move(span);
+    _fitting = -1;
+  }
+}
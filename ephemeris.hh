@@ -0,0 +1,122 @@
+// satnow: ephemeris.hh
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __SATNOW_EPHEMERIS_HH
+#define __SATNOW_EPHEMERIS_HH
+#include "tlerecord.hh"
+#include <DateTime.h>
+#include <SGP4.h>
+#include <Vector.h>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Piecewise cubic fit of every satellite's ECI trajectory over [begin, end).
+//
+// Each satellite is propagated at evenly spaced knots, and each interval
+// between two knots is the cubic Hermite polynomial that matches the SGP4
+// position and velocity at both ends. The polynomials are stored in monomial
+// form, so evaluating a position is three short Horner chains.
+//
+// The knot spacing is per satellite: a segment whose midpoint is further
+// than the error bound from SGP4 halves that satellite's spacing, and the
+// satellite is refit. A satellite that is still out of bounds at the
+// smallest spacing is not fitted.
+class EphemerisSpan {
+private:
+  int64_t _begin, _end;        // DateTime ticks.
+  std::vector<double> _steps;  // Knot spacing (seconds), 0 if not fitted.
+  std::vector<size_t> _first;  // First segment of each satellite.
+  std::vector<double> _coeffs; // kCoeffs per segment.
+
+public:
+  static constexpr size_t kCoeffs = 12; // 4 per axis, constant term first.
+
+  // A starting knot spacing for 'tle', a fraction of its orbital period.
+  static double initialStep(const TleRecord &tle);
+
+  // Fit 'models' over [begin, begin + spanSecs). 'steps' holds the initial
+  // knot spacing of each satellite and is updated with the spacing used.
+  EphemerisSpan(const std::vector<SGP4> &models, std::vector<double> &steps,
+                const DateTime &begin, double spanSecs, double maxErrorKm);
+
+  int64_t begin() const { return _begin; }
+  int64_t end() const { return _end; }
+  bool covers(int64_t ticks) const { return ticks >= _begin && ticks < _end; }
+
+  // Interpolate the position (km) and velocity (km/s) of satellite 'idx' at
+  // 'ticks', which must be covered by this span. Returns false if the
+  // satellite could not be fitted (libsgp4 threw, or the error bound could
+  // not be met), so the caller should propagate it directly.
+  bool evaluate(size_t idx, int64_t ticks, Vector &pos, Vector &vel) const {
+    const double h = _steps[idx];
+    if (h == 0.0)
+      return false;
+    const double t = (ticks - _begin) * 1e-6 / h;
+    const size_t seg = static_cast<size_t>(t);
+    const double s = t - seg;
+    const double *c = &_coeffs[(_first[idx] + seg) * kCoeffs];
+    double p[3], v[3];
+    for (int axis = 0; axis < 3; ++axis, c += 4) {
+      p[axis] = c[0] + s * (c[1] + s * (c[2] + s * c[3]));
+      v[axis] = (c[1] + s * (2.0 * c[2] + s * 3.0 * c[3])) / h;
+    }
+    pos = Vector(p[0], p[1], p[2]);
+    vel = Vector(v[0], v[1], v[2]);
+    return true;
+  }
+};
+
+// Keeps an EphemerisSpan ready for the current time.
+// Fitting happens on a background thread: the span after the current one is
+// fit as soon as the current one is in use, so a steadily advancing clock
+// never waits. When no span covers the requested time (at startup or after a
+// jump) the caller gets nothing and should propagate directly while a span
+// for that time is fit.
+class EphemerisCache {
+private:
+  std::vector<SGP4> _models; // Private copies, used only by the fit thread.
+  std::vector<double> _steps;
+  const double _maxError, _spanSecs;
+  std::mutex _lock;
+  std::condition_variable _wake;
+  std::shared_ptr<const EphemerisSpan> _current, _next;
+  int64_t _request;  // Begin ticks of the span to fit next, or -1.
+  int64_t _fitting;  // Begin ticks of the span being fit, or -1.
+  bool _stop;
+  std::thread _thread;
+
+  void run();
+  bool pending(int64_t ticks) const; // A queued or running fit covers ticks.
+
+public:
+  // Interpolate 'tles' to within 'maxErrorKm' of SGP4 (checked at segment
+  // midpoints), with each span covering 'spanMinutes'.
+  // Throws, as libsgp4 does, if the elements of a TLE are out of range.
+  EphemerisCache(const std::vector<TleRecord> &tles, double maxErrorKm,
+                 double spanMinutes = 10.0);
+  ~EphemerisCache();
+  EphemerisCache(const EphemerisCache &) = delete;
+  EphemerisCache &operator=(const EphemerisCache &) = delete;
+
+  // The span covering 'when', or nullptr if it is not ready yet.
+  std::shared_ptr<const EphemerisSpan> find(const DateTime &when);
+};
+
+#endif // __SATNOW_EPHEMERIS_HH
@@ -0,0 +1,190 @@
+// satnow: fetch.cc
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "fetch.hh"
+#include <cctype>
+#include <curl/curl.h>
+#include <memory>
+
+namespace {
+// One transfer and where its data is streamed to.
+struct Transfer {
+  FetchResult &result;
+  const SourceState &previous;
+  const FetchSink &sink;
+  size_t idx;
+  uint64_t hash;
+  CURL *curl;
+  curl_slist *headers;
+  char error[CURL_ERROR_SIZE];
+
+  Transfer(FetchResult &res, const SourceState &prev, const FetchSink &snk,
+           size_t i)
+      : result(res), previous(prev), sink(snk), idx(i), hash(kHashSeed),
+        curl(curl_easy_init()), headers(nullptr) {
+    error[0] = '\0';
+  }
+  ~Transfer() {
+    if (curl)
+      curl_easy_cleanup(curl);
+    curl_slist_free_all(headers);
+  }
+};
+} // namespace
+
+// curl write callback: hash the bytes and pass them on as they arrive.
+static size_t receive(char *data, size_t size, size_t nmemb, void *transfer) {
+  auto *t = static_cast<Transfer *>(transfer);
+  const std::string_view bytes(data, size * nmemb);
+  t->hash = hashContent(bytes, t->hash);
+  t->sink(t->idx, bytes, nullptr);
+  return bytes.size();
+}
+
+// curl header callback: keep the validators for the next conditional fetch.
+static size_t receiveHeader(char *data, size_t size, size_t nmemb,
+                            void *transfer) {
+  auto *t = static_cast<Transfer *>(transfer);
+  std::string_view line(data, size * nmemb);
+  const auto colon = line.find(':');
+  if (colon == std::string_view::npos)
+    return line.size();
+  std::string name(line.substr(0, colon));
+  for (auto &c : name)
+    c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  std::string_view value = line.substr(colon + 1);
+  const auto st = value.find_first_not_of(" \t");
+  const auto en = value.find_last_not_of(" \t\r\n");
+  value = st == std::string_view::npos ? std::string_view()
+                                       : value.substr(st, en - st + 1);
+  if (name == "etag")
+    t->result.state.etag = std::string(value);
+  else if (name == "last-modified")
+    t->result.state.lastModified = std::string(value);
+  return size * nmemb;
+}
+
+// Configure 't' and add it to 'multi'. Returns false if curl refused it.
+static bool start(CURLM *multi, Transfer &t) {
+  if (!t.previous.etag.empty())
+    t.headers = curl_slist_append(
+        t.headers, ("If-None-Match: " + t.previous.etag).c_str());
+  if (!t.previous.lastModified.empty())
+    t.headers = curl_slist_append(
+        t.headers, ("If-Modified-Since: " + t.previous.lastModified).c_str());
+  if (!t.curl ||
+      curl_easy_setopt(t.curl, CURLOPT_URL, t.result.url.c_str()) ||
+      curl_easy_setopt(t.curl, CURLOPT_FAILONERROR, 1L) ||
+      curl_easy_setopt(t.curl, CURLOPT_FOLLOWLOCATION, 1L) ||
+      curl_easy_setopt(t.curl, CURLOPT_ERRORBUFFER, t.error) ||
+      curl_easy_setopt(t.curl, CURLOPT_WRITEFUNCTION, receive) ||
+      curl_easy_setopt(t.curl, CURLOPT_WRITEDATA, &t) ||
+      curl_easy_setopt(t.curl, CURLOPT_HEADERFUNCTION, receiveHeader) ||
+      curl_easy_setopt(t.curl, CURLOPT_HEADERDATA, &t) ||
+      curl_easy_setopt(t.curl, CURLOPT_HTTPHEADER, t.headers) ||
+      curl_easy_setopt(t.curl, CURLOPT_PRIVATE, &t) ||
+      curl_multi_add_handle(multi, t.curl)) {
+    t.result.error = "Could not start the transfer";
+    return false;
+  }
+  return true;
+}
+
+// Record the outcome of the finished transfer 't', and pass it to the sink.
+static void finish(Transfer &t, CURLcode code) {
+  FetchResult &res = t.result;
+  res.ok = code == CURLE_OK;
+  if (!res.ok)
+    res.error = t.error[0] ? t.error : curl_easy_strerror(code);
+  curl_off_t bytes = 0;
+  long status = 0;
+  curl_easy_getinfo(t.curl, CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+  curl_easy_getinfo(t.curl, CURLINFO_TOTAL_TIME, &res.seconds);
+  curl_easy_getinfo(t.curl, CURLINFO_RESPONSE_CODE, &status);
+  res.bytes = static_cast<size_t>(bytes);
+  if (res.ok && status == 304) {
+    // Nothing was sent, so keep what we had (the server may have sent new
+    // validators with the 304).
+    res.notModified = true;
+    if (res.state.etag.empty())
+      res.state.etag = t.previous.etag;
+    if (res.state.lastModified.empty())
+      res.state.lastModified = t.previous.lastModified;
+    res.state.hash = t.previous.hash;
+  } else if (res.ok) {
+    res.state.hash = t.hash;
+    res.unchanged = t.previous.hash != 0 && t.previous.hash == t.hash;
+  }
+  t.sink(t.idx, std::string_view(), &res);
+}
+
+std::vector<FetchResult> fetchURLs(const std::vector<std::string> &urls,
+                                   const std::vector<SourceState> &previous,
+                                   size_t maxConnections,
+                                   const FetchSink &sink) {
+  std::vector<FetchResult> results(urls.size());
+  CURLM *multi = curl_multi_init();
+  if (!multi) {
+    for (size_t i = 0; i < urls.size(); ++i) {
+      results[i].url = urls[i];
+      results[i].error = "Could not initialize curl";
+      sink(i, std::string_view(), &results[i]);
+    }
+    return results;
+  }
+  curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS,
+                    static_cast<long>(maxConnections));
+  curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
+  std::vector<std::unique_ptr<Transfer>> transfers;
+  size_t next = 0, running = 0;
+  int stillRunning = 1;
+  while (next < urls.size() || running > 0) {
+    // Keep up to maxConnections transfers in flight.
+    for (; next < urls.size() && running < maxConnections; ++next) {
+      results[next].url = urls[next];
+      transfers.emplace_back(
+          new Transfer(results[next], previous[next], sink, next));
+      if (start(multi, *transfers.back()))
+        ++running;
+      else
+        sink(next, std::string_view(), &results[next]);
+    }
+    if (running == 0)
+      continue;
+
+    curl_multi_perform(multi, &stillRunning);
+    int pending;
+    while (CURLMsg *msg = curl_multi_info_read(multi, &pending)) {
+      if (msg->msg != CURLMSG_DONE)
+        continue;
+      Transfer *t = nullptr;
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &t);
+      const CURLcode code = msg->data.result;
+      finish(*t, code);
+      curl_multi_remove_handle(multi, t->curl);
+      curl_easy_cleanup(t->curl);
+      t->curl = nullptr;
+      --running;
+    }
+    if (stillRunning)
+      curl_multi_wait(multi, nullptr, 0, 1000, nullptr);
+  }
+
+  transfers.clear();
+  curl_multi_cleanup(multi);
+  return results;
+}
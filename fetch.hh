@@ -0,0 +1,74 @@
+// satnow: fetch.hh
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __SATNOW_FETCH_HH
+#define __SATNOW_FETCH_HH
+#include "db.hh"
+#include "tlerecord.hh"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 64-bit FNV-1a hash of 'data', continuing from 'hash' so that content can be
+// hashed in pieces. Used to tell if a source's content has changed.
+static constexpr uint64_t kHashSeed = 14695981039346656037ULL;
+inline uint64_t hashContent(std::string_view data, uint64_t hash = kHashSeed) {
+  for (const char c : data) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// The outcome of loading one TLE source.
+struct FetchResult {
+  std::string url;             // URL (or path, for a file).
+  bool ok = false;
+  std::string error;           // Why the transfer failed, if it did.
+  size_t tles = 0;             // Records parsed from the source.
+  size_t bytes = 0;            // Bytes downloaded.
+  double seconds = 0.0;        // Total transfer time.
+  SourceState state;           // To store for the next fetch.
+  bool notModified = false;    // The server answered 304 Not Modified.
+  bool unchanged = false;      // The content hash matched the last fetch.
+};
+
+// Receives the content of url 'idx' as it downloads, one piece at a time and
+// in order, and then once more with the result in 'done' (and no data) when
+// the transfer has ended, whether or not it succeeded. 'done' is nullptr
+// until then.
+using FetchSink = std::function<void(size_t idx, std::string_view data,
+                                     const FetchResult *done)>;
+
+// Download 'urls' concurrently, with at most 'maxConnections' transfers in
+// flight, handing the content to 'sink'. Transfers share one curl multi
+// handle, so connections to the same host are reused. Results are in the
+// same order as 'urls'.
+//
+// 'previous' holds what was stored from the last fetch of each url. Requests
+// are made conditional on its ETag and Last-Modified, so nothing is sent for
+// an unmodified source. Content with the same hash as before is reported as
+// unchanged, although by then 'sink' has seen it; the sink should only use
+// content whose final result is ok and neither notModified nor unchanged.
+std::vector<FetchResult> fetchURLs(const std::vector<std::string> &urls,
+                                   const std::vector<SourceState> &previous,
+                                   size_t maxConnections,
+                                   const FetchSink &sink);
+
+#endif // __SATNOW_FETCH_HH
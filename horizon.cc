@@ -0,0 +1,70 @@
+// satnow: horizon.cc
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "horizon.hh"
+#include <Globals.h>
+#include <OrbitalElements.h>
+#include <algorithm>
+#include <cmath>
+
+// Margins that keep the bounds conservative. The angle margin covers the
+// difference between geodetic and geocentric latitude, the observer's
+// altitude, and refraction. The rate margin covers perigee decay from drag.
+static const double kAngleMargin = 2.0 * kPI / 180.0;
+static const double kRateMargin = 1.1;
+static const double kEarthRate = 7.292115e-5; // Earth rotation (rad/sec).
+static const double kPolarRadius = kXKMPER * (1.0 - kF); // km.
+
+HorizonFilter::Bounds HorizonFilter::bounds(const Tle &tle) {
+  const OrbitalElements elements(tle);
+  const double a = elements.RecoveredSemiMajorAxis() * kXKMPER;
+  const double e = elements.Eccentricity();
+  const double apogee = a * (1.0 + e), perigee = a * (1.0 - e);
+
+  // Using the polar radius makes the horizon limit as large as it can be.
+  const double maxAngle =
+      ((apogee > kPolarRadius) ? std::acos(kPolarRadius / apogee) : 0.0) +
+      kAngleMargin;
+
+  // Angular rate at perigee, where the satellite moves fastest.
+  const double vPerigee = std::sqrt(kMU * (1.0 + e) / perigee);
+  const double maxRate = kRateMargin * vPerigee / perigee + kEarthRate;
+
+  // The sub-satellite point never goes further from the equator than the
+  // inclination (or its supplement for retrograde orbits), and is visible up
+  // to maxAngle beyond that.
+  const double inc = elements.Inclination();
+  return {maxAngle, maxRate, std::min(inc, kPI - inc) + maxAngle};
+}
+
+void HorizonFilter::add(const Bounds &b) {
+  _maxAngle.push_back(b.maxAngle);
+  _maxRate.push_back(b.maxRate);
+  _never.push_back(std::fabs(_latitude) > b.maxLatitude);
+}
+
+int64_t HorizonFilter::earliestRise(size_t idx, const Vector &satPos,
+                                    const Vector &obsPos, int64_t now) const {
+  if (_never[idx])
+    return kNever;
+  const double cosAngle =
+      satPos.Dot(obsPos) / (satPos.Magnitude() * obsPos.Magnitude());
+  const double angle = std::acos(std::max(-1.0, std::min(1.0, cosAngle)));
+  if (angle <= _maxAngle[idx])
+    return now;
+  const double secs = (angle - _maxAngle[idx]) / _maxRate[idx];
+  return now + static_cast<int64_t>(secs * 1.0e6); // Ticks are microseconds.
+}
@@ -0,0 +1,68 @@
+// satnow: horizon.hh
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __SATNOW_HORIZON_HH
+#define __SATNOW_HORIZON_HH
+#include <Tle.h>
+#include <Vector.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Conservative geometric bounds on when a satellite can next be visible.
+//
+// A satellite is above the horizon only while the angle at the earth's center
+// between it and the observer is below a limit set by its apogee. That angle
+// can shrink no faster than the satellite's fastest angular rate (at perigee)
+// plus the earth's rotation, so from one exact position we can bound how long
+// the satellite must stay below the horizon. Satellites whose inclination and
+// apogee never bring them over the observer's latitude are never visible.
+// All bounds err toward propagating too early, never too late.
+class HorizonFilter {
+public:
+  static constexpr int64_t kNever = INT64_MAX;
+
+private:
+  double _latitude; // Observer latitude (radians).
+  std::vector<double> _maxAngle; // Largest visible central angle (radians).
+  std::vector<double> _maxRate;  // Bound on central angle rate (rad/sec).
+  std::vector<uint8_t> _never;   // Satellite can never be above the horizon.
+
+public:
+  // What add() needs to know about a satellite. Unlike the filter, this does
+  // not depend on the observer, so it can be computed once and stored.
+  struct Bounds {
+    double maxAngle;    // Largest visible central angle (radians).
+    double maxRate;     // Bound on central angle rate (rad/sec).
+    double maxLatitude; // Furthest visible latitude (radians).
+  };
+  static Bounds bounds(const Tle &tle);
+
+  explicit HorizonFilter(double latitude) : _latitude(latitude) {}
+
+  // Add the bounds for 'tle'. Satellites are indexed in the order added.
+  void add(const Bounds &b);
+  void add(const Tle &tle) { add(bounds(tle)); }
+
+  // Earliest time (in DateTime ticks) that satellite 'idx' could rise, given
+  // its ECI position 'satPos' and the observer's ECI position 'obsPos' at
+  // 'now'. Returns 'now' if it could already be visible and kNever if it can
+  // never be visible.
+  int64_t earliestRise(size_t idx, const Vector &satPos, const Vector &obsPos,
+                       int64_t now) const;
+};
+
+#endif // __SATNOW_HORIZON_HH
@@ -0,0 +1,87 @@
+// satnow: lookangle.cc
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lookangle.hh"
+#include <Eci.h>
+#include <Globals.h>
+#include <cmath>
+
+// The math follows libsgp4's Observer::GetLookAngle(), with everything that
+// only depends on the observer and the time hoisted into setTime().
+
+LookAngleTransform::LookAngleTransform(const CoordGeodetic &geo)
+    : _geo(geo), _sinLat(std::sin(geo.latitude)),
+      _cosLat(std::cos(geo.latitude)), _sinTheta(0.0), _cosTheta(1.0) {
+  setTime(DateTime::Now(true));
+}
+
+void LookAngleTransform::setTime(const DateTime &time) {
+  const Eci observer(time, _geo);
+  const double theta = time.ToLocalMeanSiderealTime(_geo.longitude);
+  _time = time;
+  _obsPos = observer.Position();
+  _obsVel = observer.Velocity();
+  _sinTheta = std::sin(theta);
+  _cosTheta = std::cos(theta);
+}
+
+// Rotate the range vector into the observer's south/east/zenith frame and
+// convert to azimuth, elevation, range, and range rate.
+static inline void toLookAngle(double sinLat, double cosLat, double sinTheta,
+                               double cosTheta, double rx, double ry,
+                               double rz, double rvx, double rvy, double rvz,
+                               double &az, double &el, double &range,
+                               double &rate) {
+  const double w = std::sqrt(rx * rx + ry * ry + rz * rz);
+  const double topS = sinLat * cosTheta * rx + sinLat * sinTheta * ry -
+                      cosLat * rz;
+  const double topE = -sinTheta * rx + cosTheta * ry;
+  const double topZ = cosLat * cosTheta * rx + cosLat * sinTheta * ry +
+                      sinLat * rz;
+  az = std::atan(-topE / topS);
+  if (topS > 0.0)
+    az += kPI;
+  if (az < 0.0)
+    az += 2.0 * kPI;
+  el = std::asin(topZ / w);
+  range = w;
+  rate = (rx * rvx + ry * rvy + rz * rvz) / w;
+}
+
+CoordTopocentric LookAngleTransform::lookAngle(const Vector &pos,
+                                               const Vector &vel) const {
+  CoordTopocentric la;
+  toLookAngle(_sinLat, _cosLat, _sinTheta, _cosTheta, pos.x - _obsPos.x,
+              pos.y - _obsPos.y, pos.z - _obsPos.z, vel.x - _obsVel.x,
+              vel.y - _obsVel.y, vel.z - _obsVel.z, la.azimuth, la.elevation,
+              la.range, la.range_rate);
+  return la;
+}
+
+void LookAngleTransform::lookAngles(size_t n, const EciArrays &eci,
+                                    const uint32_t *dest,
+                                    const LookAngleArrays &out) const {
+  const double sinLat = _sinLat, cosLat = _cosLat;
+  const double sinTheta = _sinTheta, cosTheta = _cosTheta;
+  const Vector p = _obsPos, v = _obsVel;
+  for (size_t i = 0; i < n; ++i) {
+    const uint32_t d = dest[i];
+    toLookAngle(sinLat, cosLat, sinTheta, cosTheta, eci.x[i] - p.x,
+                eci.y[i] - p.y, eci.z[i] - p.z, eci.vx[i] - v.x,
+                eci.vy[i] - v.y, eci.vz[i] - v.z, out.az[d], out.el[d],
+                out.range[d], out.rate[d]);
+  }
+}
@@ -0,0 +1,70 @@
+// satnow: lookangle.hh
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __SATNOW_LOOKANGLE_HH
+#define __SATNOW_LOOKANGLE_HH
+#include <CoordGeodetic.h>
+#include <CoordTopocentric.h>
+#include <DateTime.h>
+#include <Vector.h>
+#include <cstddef>
+#include <cstdint>
+
+// ECI positions (km) and velocities (km/s) stored as one array per component.
+struct EciArrays {
+  const double *x, *y, *z, *vx, *vy, *vz;
+};
+
+// Look angles stored as one array per component (radians and km).
+struct LookAngleArrays {
+  double *az, *el, *range, *rate;
+};
+
+// Computes look angles from one observer at one point in time.
+//
+// Observer::GetLookAngle() derives the observer's ECI position and the
+// sidereal rotation for each satellite it is given. Here they are computed
+// once by setTime(), and every look angle after that is a fixed translation
+// and rotation of the satellite's ECI state. After setTime() the transform is
+// read-only, so one instance can be shared by threads.
+class LookAngleTransform {
+private:
+  CoordGeodetic _geo;
+  double _sinLat, _cosLat;
+  DateTime _time;
+  Vector _obsPos, _obsVel;     // Observer ECI state at _time.
+  double _sinTheta, _cosTheta; // Local mean sidereal time at _time.
+
+public:
+  // 'geo' is the observer's location in the libsgp4 convention (radians, km).
+  explicit LookAngleTransform(const CoordGeodetic &geo);
+
+  // Set the time that the following look angles are calculated for.
+  void setTime(const DateTime &time);
+  const DateTime &getTime() const { return _time; }
+  const CoordGeodetic &getLocation() const { return _geo; }
+  const Vector &getObserverPosition() const { return _obsPos; }
+
+  // Look angle of a satellite at 'pos'/'vel' (ECI, at getTime()).
+  CoordTopocentric lookAngle(const Vector &pos, const Vector &vel) const;
+
+  // Look angles for 'n' satellites. Input i is read from index i of 'eci' and
+  // its result is written to index dest[i] of 'out'.
+  void lookAngles(size_t n, const EciArrays &eci, const uint32_t *dest,
+                  const LookAngleArrays &out) const;
+};
+
+#endif // __SATNOW_LOOKANGLE_HH
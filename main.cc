@@ -17,13 +17,23 @@
 #include "main.hh"
 #include "db.hh"
 #include "display.hh"
+#include "fetch.hh"
+#include "observers.hh"
+#include "passes.hh"
+#include "pipeline.hh"
+#include "sweep.hh"
+#include "tleparser.hh"
 #include <cctype>
+#include <chrono>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <curl/curl.h>
 #include <fstream>
+#include <functional>
 #include <getopt.h>
 #include <iostream>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -39,6 +49,29 @@ static const struct option opts[] = {
     {"update", required_argument, nullptr, 'u'},
     {"db", required_argument, nullptr, 'd'},
     {"verbose", no_argument, nullptr, 'v'},
+    {"bench", required_argument, nullptr, 'b'},
+    {"threads", required_argument, nullptr, 't'},
+    {"no-simd", no_argument, nullptr, 's'},
+    {"horizon-filter", no_argument, nullptr, 'z'},
+    {"passes", required_argument, nullptr, 'p'},
+    {"interpolate", required_argument, nullptr, 'i'},
+    {"observers", required_argument, nullptr, 'o'},
+    {"limit", required_argument, nullptr, 'k'},
+    {"bench-parse", required_argument, nullptr, 'P'},
+    {"connections", required_argument, nullptr, 'c'},
+    {"by-elevation", no_argument, nullptr, 'e'},
+    {"refetch", no_argument, nullptr, 'f'},
+    {"db-batch", required_argument, nullptr, 'w'},
+    {"bench-write", required_argument, nullptr, 'W'},
+    {"name", required_argument, nullptr, 'n'},
+    {"norad", required_argument, nullptr, 'N'},
+    {"max-period", required_argument, nullptr, 'm'},
+    {"min-inclination", required_argument, nullptr, 'I'},
+    {"max-epoch-age", required_argument, nullptr, 'A'},
+    {"time", required_argument, nullptr, 'T'},
+    {"start", required_argument, nullptr, 'S'},
+    {"end", required_argument, nullptr, 'E'},
+    {"step", required_argument, nullptr, 'D'},
 #if HAVE_GUI
     {"gui", no_argument, nullptr, 'g'},
     {"refresh", required_argument, nullptr, 'r'},
@@ -48,7 +81,20 @@ static const struct option opts[] = {
 [[noreturn]] static void usage(const char *execname) {
   std::cout << "satnow v" << VER << std::endl
             << "Usage: " << execname << " --lat=val --lon=val "
-            << "[-h -v --alt=val --update=file --db=file]" << std::endl;
+            << "[-h -v --alt=val --update=file --db=file]" << std::endl
+            << "       [--threads=N --no-simd --horizon-filter --bench=N]"
+            << std::endl
+            << "       [--passes=hours --interpolate=km --observers=file]"
+            << std::endl
+            << "       [--limit=K --by-elevation --bench-parse=file]"
+            << std::endl
+            << "       [--connections=N --refetch --db-batch=N]" << std::endl
+            << "       [--bench-write=file --name=pattern --norad=N[-M]]"
+            << std::endl
+            << "       [--max-period=min --min-inclination=deg "
+            << "--max-epoch-age=days]" << std::endl
+            << "       [--time=YYYY-MM-DDThh:mm:ssZ --start=time --end=time "
+            << "--step=secs]" << std::endl;
 #if HAVE_GUI
   std::cout << "       [--gui --refresh=msec] " << std::endl;
 #endif
@@ -60,6 +106,30 @@ static const struct option opts[] = {
             << "  --help/-h:    This help message." << std::endl
             << "  --verbose/-v: Output additional data (for debugging)."
             << std::endl
+            << "  --threads=<count>: Threads used to calculate look angles "
+            << "(default: 1)." << std::endl
+            << "  --no-simd: Do not use the vectorized SGP4 propagator."
+            << std::endl
+            << "  --horizon-filter: On refresh, skip satellites that cannot "
+            << "have risen yet." << std::endl
+            << "  --bench=<iterations>: Time look angle refreshes and exit."
+            << std::endl
+            << "  --interpolate=<km>: On refresh, interpolate positions from a "
+            << "cached fit" << std::endl
+            << "    that stays within 'km' of SGP4." << std::endl
+            << "  --bench-parse=<file>: Time parsing the TLE 'file' and exit "
+            << "(uses --bench" << std::endl
+            << "    iterations, default 1)." << std::endl
+            << "  --limit=<K>: Only list the K closest (or highest) satellites."
+            << std::endl
+            << "  --by-elevation: Order by elevation (highest first)."
+            << std::endl
+            << "  --observers=<file>: List look angles for each site in 'file' "
+            << "and exit." << std::endl
+            << "    Each line of 'file' is: name latitude longitude altitude"
+            << std::endl
+            << "  --passes=<hours>: List the passes (rise, culmination, set) "
+            << "over the next 'hours' and exit." << std::endl
 #if HAVE_GUI
             << "  --gui: Enable curses/gui mode." << std::endl
             << "  --refresh/-r: Number of milliseconds to refresh gui."
@@ -69,6 +139,39 @@ static const struct option opts[] = {
             << "    Where 'sources' is a text file containing a " << std::endl
             << "    list of URLs that point to a TLE .txt file. " << std::endl
             << "    Each source must be on its own line in the file."
+            << std::endl
+            << "  --connections=<count>: Download up to 'count' sources at "
+            << "once (default: 8)." << std::endl
+            << "  --refetch: On update, reload every source even if it has not "
+            << "changed." << std::endl
+            << "  --db-batch=<rows>: On update, write 'rows' TLEs per "
+            << "transaction (default: " << DB::kDefaultBatchSize << ")."
+            << std::endl
+            << "  --bench-write=<file>: Time storing the TLEs in 'file' in a "
+            << "scratch database" << std::endl
+            << "    and exit (uses --db-batch)." << std::endl
+            << "  --name=<pattern>: Only satellites whose name matches "
+            << "'pattern' ('*' and '?'" << std::endl
+            << "    are wildcards; without them, names containing 'pattern' "
+            << "match)." << std::endl
+            << "  --norad=<N or N-M>: Only satellite N, or satellites N to M."
+            << std::endl
+            << "  --max-period=<minutes>: Only satellites with a shorter "
+            << "orbital period." << std::endl
+            << "  --min-inclination=<degrees>: Only satellites with a higher "
+            << "inclination." << std::endl
+            << "  --max-epoch-age=<days>: Only TLEs with an epoch within "
+            << "'days' of now." << std::endl
+            << "  --time=<ISO 8601 UTC time>: Calculate for this time rather "
+            << "than now, using" << std::endl
+            << "    each satellite's stored TLE with the closest epoch."
+            << std::endl
+            << "  --start=<ISO 8601 UTC time>: First step of --end (default: "
+            << "--time, otherwise now)." << std::endl
+            << "  --end=<ISO 8601 UTC time>: List look angles at each step "
+            << "from --start to 'time'" << std::endl
+            << "    and exit. Steps are spread over --threads." << std::endl
+            << "  --step=<seconds>: Time between steps (default: 60)."
             << std::endl;
   exit(EXIT_SUCCESS);
 }
@@ -89,8 +192,8 @@ bool readLine(FILE *fp, std::string &str) {
 }
 
 // Return a vector of TLE instances for each TLE entry.
-// This supports both forms of TLE where each line of data (two of them) are 69
-// bytes each, and the optional name line is 24 bytes.
+// This is the original getline() based reader; parseTLEs() replaced it, and it
+// is only kept as the baseline for --bench-parse.
 static std::vector<Tle> readTLEs(const std::string &fname, FILE *fp) {
   std::vector<Tle> tles;
   std::string line1, line2, name;
@@ -127,67 +230,21 @@ static std::vector<Tle> readTLEs(const std::string &fname, FILE *fp) {
   return tles;
 }
 
-static bool tryParseFile(const std::string &fname, std::vector<Tle> &tles) {
-  // If it looks like a URL, don't try to open it.
-  if (fname.find("://") != std::string::npos)
-    return false;
-
-  FILE *fp; // We use c-style file i/o so we can use tmpfile in tryParseURL.
-  if (!(fp = fopen(fname.c_str(), "r")))
-    return false;
-
-  // Read the new TLEs and add them to 'tles'.
-  auto newTLEs = readTLEs(fname, fp);
-  tles.insert(tles.end(), std::make_move_iterator(newTLEs.begin()),
-              std::make_move_iterator(newTLEs.end()));
-  fclose(fp);
-  return true;
-}
-
-static bool tryParseURL(const std::string &fname, std::vector<Tle> &tles) {
-  CURL *crl = curl_easy_init();
-  if (!crl)
-    return false;
-  if (curl_easy_setopt(crl, CURLOPT_URL, fname.c_str()))
-    return false;
-
-  // Ignore any "URLs" that do not have a protocol delimiter.
-  if (fname.find("://") == std::string::npos)
-    return false;
-
-  // Prepare to download the TLE data into a temp file.
-  FILE *fp = tmpfile();
-  if (!fp)
-    return false;
-  if (curl_easy_setopt(crl, CURLOPT_WRITEDATA, fp)) {
-    fclose(fp);
-    curl_easy_cleanup(crl);
-    return false;
-  }
-
-  // Download the data.
-  std::cout << "[+] Downloading contents from " << fname << std::endl;
-  bool ok = curl_easy_perform(crl) == CURLE_OK;
-  curl_easy_cleanup(crl);
-
-  // Read the new TLEs and add them to 'tles'.
-  rewind(fp);
-  auto newTLEs = readTLEs(fname, fp);
-  tles.insert(tles.end(), std::make_move_iterator(newTLEs.begin()),
-              std::make_move_iterator(newTLEs.end()));
-  fclose(fp);
-  return ok;
-}
-
-// Update the database of TLEs.
-static void update(const char *sourceFile, DB &db, bool verbose) {
+// Update the database of TLEs from the sources listed in 'sourceFile'.
+// Sources are downloaded (up to 'maxConnections' at once), parsed (with
+// 'nThreads' threads) and written (in transactions of 'batchSize') at the
+// same time, see runUpdatePipeline(). Sources that have not changed since the
+// last update are skipped, unless 'refetch' is set.
+static void update(const char *sourceFile, DB &db, bool verbose,
+                   size_t nThreads, size_t maxConnections, bool refetch,
+                   size_t batchSize) {
   assert(sourceFile && db.ok() && "Invalid input to update.");
 
   // Parse the source file (one entry per line).
   std::string line;
   std::ifstream fh(sourceFile);
   size_t lineNumber = 0;
-  std::vector<Tle> results;
+  std::vector<UpdateSource> sources;
   while (std::getline(fh, line)) {
     ++lineNumber;
     // Trim white space from both ends.
@@ -214,49 +271,851 @@ static void update(const char *sourceFile, DB &db, bool verbose) {
     // Get the trimmed string.
     const auto str = line.substr(st, en - st);
 
-    // Parse the contents at the url or in the file.
     std::cerr << "[+] Loading TLEs from '" << str << '\'' << std::endl;
-    if (!tryParseFile(str, results) && !tryParseURL(str, results)) {
+    SourceState state;
+    if (!refetch)
+      db.getSource(str, state);
+    if (str.find("://") != std::string::npos) {
+      sources.push_back({str, false, state});
+      continue;
+    }
+
+    // Files are hashed up front, so an unchanged file is never read again.
+    const MappedFile file(str);
+    if (!file.ok()) {
       std::cerr << "[-] Unknown entry in " << sourceFile << " Line "
                 << lineNumber << std::endl;
       continue;
     }
+    const uint64_t hash = hashContent(file.view());
+    if (state.hash != 0 && state.hash == hash) {
+      std::cout << "[+] Unchanged since the last update: " << str
+                << std::endl;
+      continue;
+    }
+    state.hash = hash;
+    sources.push_back({str, true, state});
   }
 
-  // Update the database.
-  size_t count = 0;
-  for (const auto &tle : results) {
-    db.update(tle);
-    if (verbose)
-      std::cout << "[+] Refreshing [" << (++count) << '/' << results.size()
-                << "]: " << std::to_string(tle.NoradNumber()) << " ("
-                << tle.Name() << ") [" << (db.ok() ? "Good" : "Failed") << ']'
+  PipelineOptions opts;
+  opts.parsers = nThreads;
+  opts.maxConnections = maxConnections;
+  opts.batchSize = batchSize;
+  opts.verbose = verbose;
+  PipelineStats stats;
+  const auto results = runUpdatePipeline(sources, db, opts, stats);
+
+  for (const auto &res : results) {
+    if (res.ok && res.notModified)
+      std::cout << "[+] Not modified since the last update: " << res.url
+                << std::endl;
+    else if (res.ok && res.unchanged)
+      std::cout << "[+] Unchanged since the last update: " << res.url << " ("
+                << res.bytes << " bytes in " << res.seconds << " seconds)"
                 << std::endl;
+    else if (res.ok)
+      std::cout << "[+] Loaded " << res.url << ": " << res.tles << " TLEs, "
+                << res.bytes << " bytes in " << res.seconds << " seconds"
+                << std::endl;
+    else
+      std::cerr << "[-] Error loading " << res.url << ": " << res.error
+                << std::endl;
+  }
+
+  const double mb = 1024.0 * 1024.0;
+  const auto &fetch = stats.fetch, &parse = stats.parse, &write = stats.write;
+  std::cout << "[+] Fetch: " << fetch.items << " sources, "
+            << fetch.bytes / mb << " MB in " << fetch.seconds << " seconds ("
+            << fetch.bytes / mb / std::max(fetch.seconds, 1e-9)
+            << " MB/s), waited on the parsers " << fetch.blocked << " times"
+            << std::endl
+            << "[+] Parse: " << parse.items << " TLEs from "
+            << parse.bytes / mb << " MB in " << parse.seconds
+            << " seconds busy over " << std::max<size_t>(nThreads, 1)
+            << " threads (" << parse.bytes / mb / std::max(parse.seconds, 1e-9)
+            << " MB/s), waited on the writer " << parse.blocked
+            << " times, idle " << parse.starved << " times" << std::endl
+            << "[+] Write: " << write.items << " TLEs in " << write.seconds
+            << " seconds busy ("
+            << write.items / std::max(write.seconds, 1e-9)
+            << " TLEs/s), idle " << write.starved << " times" << std::endl
+            << "[+] Skipped " << stats.duplicates
+            << " older or repeated copies and " << stats.current
+            << " TLEs the database already had: "
+            << stats.duplicates + stats.current << " writes avoided"
+            << std::endl
+            << "[+] Archived " << stats.archived
+            << " older TLEs in the history" << std::endl
+            << "[+] Updated in " << stats.seconds << " seconds" << std::endl;
+
+  // Only now that their records are stored can changed sources be skipped.
+  for (const auto &res : results)
+    if (res.ok && !res.notModified && !res.unchanged)
+      db.updateSource(res.url, res.state);
+}
+
+size_t SatLookAngles::addStorage(const TleRecord &rec) {
+  const size_t idx = _tles.size();
+  _models.emplace_back();
+  _tles.push_back(rec);
+  _az.push_back(0.0);
+  _el.push_back(0.0);
+  _range.push_back(0.0);
+  _rate.push_back(0.0);
+  _nextExact.push_back(0);
+  _stale.push_back(0);
+  _order.push_back(static_cast<uint32_t>(idx));
+  _ephemeris.reset(); // Refit with the new satellite on the next refresh.
+  return idx;
+}
+
+// Rewrite the snapshot at 'path' if it does not match the database.
+static void refreshSnapshot(DB &db, const std::string &path) {
+  {
+    const CatalogSnapshot current(path);
+    if (current.ok() && current.generation() == db.generation())
+      return;
+  }
+  const auto start = std::chrono::steady_clock::now();
+  const long count = CatalogSnapshot::write(db, path);
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  if (count < 0)
+    std::cerr << "[-] Error writing snapshot '" << path << '\'' << std::endl;
+  else
+    std::cout << "[+] Wrote snapshot of " << count << " TLEs to '" << path
+              << "' in " << elapsed.count() << " seconds" << std::endl;
+}
+
+void SatLookAngles::add(const TleRecord &rec) {
+  const size_t idx = addStorage(rec);
+  const Tle tle = rec.toTle();
+  _models[idx].reset(new SGP4(tle));
+  _filter.add(tle);
+  if (_useBatch && SGP4Batch::isNearEarth(tle)) {
+    _batch.add(tle);
+    _batchSats.push_back(static_cast<uint32_t>(idx));
+  } else
+    _scalarSats.push_back(static_cast<uint32_t>(idx));
+  updateLookAngle(idx);
+}
+
+void SatLookAngles::add(const SnapshotRecord &rec) {
+  const size_t idx = addStorage(rec.tle);
+  _filter.add(rec.bounds);
+  if (_useBatch && rec.nearEarth) {
+    _batch.add(rec.constants);
+    _batchSats.push_back(static_cast<uint32_t>(idx));
+  } else
+    _scalarSats.push_back(static_cast<uint32_t>(idx));
+}
+
+// Refresh the batched satellites in blocks [beginBlock, endBlock).
+void SatLookAngles::updateBatch(size_t beginBlock, size_t endBlock) {
+  const int64_t now = _time.Ticks();
+  const LookAngleArrays hot = {_az.data(), _el.data(), _range.data(),
+                               _rate.data()};
+  for (size_t block = beginBlock; block < endBlock; ++block) {
+    const size_t begin = block * SGP4Batch::kBlock;
+    const size_t end = std::min(begin + SGP4Batch::kBlock, _batch.size());
+
+    // Skip the block if none of its satellites can have risen yet.
+    if (_opts.horizonFilter) {
+      bool due = false;
+      for (size_t slot = begin; slot < end && !due; ++slot)
+        due = _nextExact[_batchSats[slot]] <= now;
+      if (!due) {
+        for (size_t slot = begin; slot < end; ++slot)
+          _stale[_batchSats[slot]] = 1;
+        continue;
+      }
+    }
+
+    _batch.propagate(_time, block, block + 1);
+    const EciArrays eci = {_batch.output(SGP4Batch::X) + begin,
+                           _batch.output(SGP4Batch::Y) + begin,
+                           _batch.output(SGP4Batch::Z) + begin,
+                           _batch.output(SGP4Batch::VX) + begin,
+                           _batch.output(SGP4Batch::VY) + begin,
+                           _batch.output(SGP4Batch::VZ) + begin};
+    _view.lookAngles(end - begin, eci, _batchSats.data() + begin, hot);
+    for (size_t slot = begin; slot < end; ++slot) {
+      if (!_batch.valid(slot))
+        updateLookAngle(_batchSats[slot]); // Let libsgp4 report it.
+      else
+        schedule(_batchSats[slot], _batch.position(slot));
+    }
+  }
+}
+
+// Refresh satellites [begin, end) from the interpolated 'span'.
+void SatLookAngles::updateInterpolated(const EphemerisSpan &span,
+                                       size_t begin, size_t end) {
+  const int64_t now = _time.Ticks();
+  Vector pos, vel;
+  for (size_t idx = begin; idx < end; ++idx) {
+    if (_opts.horizonFilter && _nextExact[idx] > now)
+      _stale[idx] = 1;
+    else if (span.evaluate(idx, now, pos, vel)) {
+      setLookAngle(idx, _view.lookAngle(pos, vel));
+      schedule(idx, pos);
+    } else
+      updateLookAngle(idx);
+  }
+}
+
+void SatLookAngles::updateTimeAndPositions() {
+  updatePositions(_opts.time ? DateTime(_opts.time) : DateTime::Now(true));
+}
+
+void SatLookAngles::updatePositions(const DateTime &time) {
+  setTime(time);
+  if (_opts.maxInterpError > 0.0) {
+    if (!_ephemeris)
+      _ephemeris.reset(new EphemerisCache(_tles, _opts.maxInterpError));
+    if (const auto span = _ephemeris->find(_time)) {
+      _pool->parallelFor(_tles.size(), [&](size_t begin, size_t end) {
+        updateInterpolated(*span, begin, end);
+      });
+      return;
+    }
   }
+  _pool->parallelFor(_batch.blocks(), [this](size_t begin, size_t end) {
+    updateBatch(begin, end);
+  });
+  _pool->parallelFor(_scalarSats.size(), [this](size_t begin, size_t end) {
+    const int64_t now = _time.Ticks();
+    for (size_t i = begin; i < end; ++i) {
+      const size_t idx = _scalarSats[i];
+      if (_opts.horizonFilter && _nextExact[idx] > now)
+        _stale[idx] = 1;
+      else
+        updateLookAngle(idx);
+    }
+  });
+}
+
+// Keep the best LookAngleOptions::limit satellites, in order, as the rows.
+template <typename Better> void SatLookAngles::selectBest(Better better) {
+  const size_t limit = _opts.limit;
+  std::vector<uint32_t> best;
+  std::mutex lock;
+  _pool->parallelFor(_tles.size(), [&](size_t begin, size_t end) {
+    // Heap of the best satellites in this chunk, with the worst on top.
+    std::vector<uint32_t> heap;
+    heap.reserve(limit);
+    for (size_t i = begin; i < end; ++i) {
+      const uint32_t idx = static_cast<uint32_t>(i);
+      if (heap.size() < limit) {
+        heap.push_back(idx);
+        std::push_heap(heap.begin(), heap.end(), better);
+      } else if (better(idx, heap.front())) {
+        std::pop_heap(heap.begin(), heap.end(), better);
+        heap.back() = idx;
+        std::push_heap(heap.begin(), heap.end(), better);
+      }
+    }
+    std::lock_guard<std::mutex> lk(lock);
+    best.insert(best.end(), heap.begin(), heap.end());
+  });
+
+  const size_t rows = std::min(limit, best.size());
+  std::partial_sort(best.begin(), best.begin() + rows, best.end(), better);
+  best.resize(rows);
+  _order = std::move(best);
+  ++_sortStats.topK;
+}
+
+template <typename Better> void SatLookAngles::sortBy(Better better) {
+  if (_opts.limit > 0 && _opts.limit < _tles.size()) {
+    selectBest(better);
+    return;
+  }
+  if (std::is_sorted(_order.begin(), _order.end(), better)) {
+    ++_sortStats.sorted;
+    return;
+  }
+
+  // Insertion sort, within a budget of element moves.
+  const size_t budget = kSortMovesPerSat * _order.size();
+  size_t moves = 0;
+  for (size_t i = 1; i < _order.size() && moves <= budget; ++i) {
+    const uint32_t idx = _order[i];
+    size_t j = i;
+    for (; j > 0 && better(idx, _order[j - 1]); --j)
+      _order[j] = _order[j - 1];
+    _order[j] = idx;
+    moves += i - j;
+  }
+  if (moves <= budget) {
+    ++_sortStats.insertion;
+    return;
+  }
+  std::sort(_order.begin(), _order.end(), better);
+  ++_sortStats.full;
+}
+
+// Ties are broken by index, so the order doesn't depend on how the work was
+// split between threads.
+void SatLookAngles::sort() {
+  if (_opts.byElevation) {
+    const double *el = _el.data();
+    sortBy([el](uint32_t a, uint32_t b) {
+      return el[a] > el[b] || (el[a] == el[b] && a < b);
+    });
+  } else {
+    const double *range = _range.data();
+    sortBy([range](uint32_t a, uint32_t b) {
+      return range[a] < range[b] || (range[a] == range[b] && a < b);
+    });
+  }
+}
+
+// Visit the TLEs in 'db' matching 'filter': the current ones, or if 'when'
+// (DateTime ticks) is not 0, those with the epoch closest to 'when'.
+static size_t
+forEachTLEAsOf(DB &db, int64_t when, const TleFilter &filter,
+               const std::function<void(const TleRecord &)> &visit) {
+  return when ? db.forEachTLEAt(when, visit, filter)
+              : db.forEachTLE(visit, filter);
 }
 
 SatLookAngles getSatellitesAndLookAngles(double lat, double lon, double alt,
-                                         DB &db) {
-  SatLookAngles sats(lat, lon, alt);
+                                         DB &db, const LookAngleOptions &opts,
+                                         const TleFilter &filter) {
+  SatLookAngles sats(lat, lon, alt, opts);
 
-  // Get the TLEs.
-  std::vector<Tle> tles = db.fetchTLEs();
+  // Add the TLEs as they are read (this will automatically generate look
+  // angles.).
+  forEachTLEAsOf(db, opts.time, filter,
+                 [&sats](const TleRecord &tle) { sats.add(tle); });
 
-  // Add the TLEs (this will automatically generate look angles.).
-  for (const auto &tle : tles)
-    sats.add(tle);
+  // Sort by increasing range (or as configured by opts).
+  sats.sort();
+  return sats;
+}
 
-  // Sort by increasing range.
+SatLookAngles getSatellitesAndLookAngles(double lat, double lon, double alt,
+                                         const CatalogSnapshot &snapshot,
+                                         const LookAngleOptions &opts) {
+  SatLookAngles sats(lat, lon, alt, opts);
+  for (size_t i = 0; i < snapshot.size(); ++i)
+    sats.add(snapshot[i]);
+  sats.updateTimeAndPositions();
   sats.sort();
   return sats;
 }
 
+// Time 'iterations' look angle refreshes and report the average cost.
+// For comparison, also time building a fresh SGP4 model for every satellite,
+// which is what each refresh cost before the models were cached.
+static void benchmark(SatLookAngles &sats, int iterations) {
+  using Clock = std::chrono::steady_clock;
+  using MSecs = std::chrono::duration<double, std::milli>;
+  std::cout << "[+] Benchmarking " << iterations << " refreshes of "
+            << sats.getTLEs().size() << " satellites." << std::endl;
+
+  auto start = Clock::now();
+  for (int i = 0; i < iterations; ++i)
+    sats.updateTimeAndPositions();
+  const MSecs cached = Clock::now() - start;
+
+  const SortStats before = sats.getSortStats();
+  start = Clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    sats.updateTimeAndPositions();
+    sats.sort();
+  }
+  const MSecs sorted = Clock::now() - start;
+  const SortStats &after = sats.getSortStats();
+
+  const auto now = sats.getTime();
+  start = Clock::now();
+  for (int i = 0; i < iterations; ++i)
+    for (const auto &tle : sats.getTLEs()) {
+      const auto model = SGP4(tle.toTle());
+      (void)model.FindPosition(now);
+    }
+  const MSecs uncached = Clock::now() - start;
+
+  std::cout << "[+] Refresh (cached models):  " << cached.count() / iterations
+            << " ms" << std::endl
+            << "[+] Refresh (rebuilt models): "
+            << uncached.count() / iterations << " ms" << std::endl
+            << "[+] Refresh and sort: " << sorted.count() / iterations
+            << " ms (already sorted: " << after.sorted - before.sorted
+            << ", insertion: " << after.insertion - before.insertion
+            << ", full: " << after.full - before.full
+            << ", top-k: " << after.topK - before.topK << ')' << std::endl;
+}
+
+// Compare each batch SGP4 kernel against libsgp4 for the near-earth
+// satellites in 'sats': report throughput (satellites per second) and the
+// largest position difference from libsgp4 over 'iterations' time steps.
+static void benchmarkBatch(const SatLookAngles &sats, int iterations) {
+  using Clock = std::chrono::steady_clock;
+  using Secs = std::chrono::duration<double>;
+  std::vector<SGP4> models;
+  SGP4Batch batch;
+  for (const auto &rec : sats.getTLEs()) {
+    const Tle tle = rec.toTle();
+    if (SGP4Batch::isNearEarth(tle)) {
+      models.emplace_back(tle);
+      batch.add(tle);
+    }
+  }
+  if (models.empty())
+    return;
+
+  // One minute apart, so each iteration exercises a different time.
+  std::vector<DateTime> times;
+  const auto now = sats.getTime();
+  for (int i = 0; i < iterations; ++i)
+    times.push_back(now.AddMinutes(i));
+
+  // Reference positions from libsgp4. Satellites libsgp4 rejects are skipped.
+  std::vector<std::vector<Vector>> expected(times.size());
+  std::vector<std::vector<bool>> ok(times.size());
+  auto start = Clock::now();
+  for (size_t t = 0; t < times.size(); ++t)
+    for (const auto &model : models) {
+      try {
+        expected[t].push_back(model.FindPosition(times[t]).Position());
+        ok[t].push_back(true);
+      } catch (...) {
+        expected[t].push_back(Vector());
+        ok[t].push_back(false);
+      }
+    }
+  const Secs scalar = Clock::now() - start;
+  const double total = static_cast<double>(models.size()) * times.size();
+  std::cout << "[+] SGP4 " << models.size()
+            << " near-earth satellites, libsgp4: " << total / scalar.count()
+            << " sats/sec" << std::endl;
+
+  for (const auto kernel : {SGP4Batch::Kernel::Generic, SGP4Batch::Kernel::AVX2,
+                            SGP4Batch::Kernel::AVX512}) {
+    if (!SGP4Batch::isSupported(kernel))
+      continue;
+    batch.setKernel(kernel);
+    double maxErr = 0.0;
+    Secs elapsed(0);
+    for (size_t t = 0; t < times.size(); ++t) {
+      start = Clock::now();
+      batch.propagate(times[t], 0, batch.blocks());
+      elapsed += Clock::now() - start;
+      for (size_t i = 0; i < batch.size(); ++i) {
+        if (ok[t][i] != batch.valid(i))
+          std::cerr << "[-] Kernel " << SGP4Batch::kernelName(kernel)
+                    << " disagrees with libsgp4 on validity of satellite "
+                    << i << std::endl;
+        if (ok[t][i] && batch.valid(i)) {
+          const Vector pos = batch.position(i);
+          const double err = (pos - expected[t][i]).Magnitude();
+          maxErr = std::max(maxErr, err);
+        }
+      }
+    }
+    std::cout << "[+] SGP4 batch (" << SGP4Batch::kernelName(kernel)
+              << "): " << total / elapsed.count()
+              << " sats/sec, max error: " << maxErr << " km" << std::endl;
+  }
+}
+
+// Compare interpolating from an EphemerisSpan against propagating with
+// libsgp4, for several error bounds: report the fit time, the evaluation
+// throughput, and the largest position difference over 'iterations' times
+// spread across the span.
+static void benchmarkEphemeris(const SatLookAngles &sats, int iterations) {
+  using Clock = std::chrono::steady_clock;
+  using Secs = std::chrono::duration<double>;
+  const double spanSecs = 600.0;
+  std::vector<SGP4> models;
+  std::vector<double> initialSteps;
+  for (const auto &tle : sats.getTLEs()) {
+    models.emplace_back(tle.toTle());
+    initialSteps.push_back(EphemerisSpan::initialStep(tle));
+  }
+  if (models.empty())
+    return;
+
+  // Offset the samples so they don't land on knots.
+  const auto now = sats.getTime();
+  std::vector<DateTime> times;
+  for (int i = 0; i < iterations; ++i)
+    times.push_back(now.AddSeconds((i + 0.37) * spanSecs / iterations));
+
+  std::vector<std::vector<Vector>> expected(times.size());
+  std::vector<std::vector<bool>> ok(times.size());
+  auto start = Clock::now();
+  for (size_t t = 0; t < times.size(); ++t)
+    for (const auto &model : models) {
+      try {
+        expected[t].push_back(model.FindPosition(times[t]).Position());
+        ok[t].push_back(true);
+      } catch (...) {
+        expected[t].push_back(Vector());
+        ok[t].push_back(false);
+      }
+    }
+  const Secs scalar = Clock::now() - start;
+  const double total = static_cast<double>(models.size()) * times.size();
+  std::cout << "[+] Ephemeris " << models.size()
+            << " satellites, libsgp4: " << total / scalar.count()
+            << " sats/sec" << std::endl;
+
+  for (const double bound : {1.0, 0.1, 0.01, 0.001}) {
+    std::vector<double> steps = initialSteps;
+    start = Clock::now();
+    const EphemerisSpan span(models, steps, now, spanSecs, bound);
+    const Secs fit = Clock::now() - start;
+
+    double maxErr = 0.0;
+    Vector pos, vel;
+    start = Clock::now();
+    for (size_t t = 0; t < times.size(); ++t) {
+      const int64_t ticks = times[t].Ticks();
+      for (size_t i = 0; i < models.size(); ++i)
+        if (span.evaluate(i, ticks, pos, vel) && ok[t][i])
+          maxErr = std::max(maxErr, (pos - expected[t][i]).Magnitude());
+    }
+    const Secs elapsed = Clock::now() - start;
+    std::cout << "[+] Ephemeris (bound " << bound
+              << " km): fit: " << fit.count() * 1000.0
+              << " ms, eval: " << total / elapsed.count()
+              << " sats/sec, max error: " << maxErr << " km" << std::endl;
+  }
+}
+
+// Print the look angles of every satellite in the DB that matches 'filter'
+// from each of 'sites' at 'when' (DateTime ticks; 0: now), sorted by range.
+static void showSites(const std::vector<Site> &sites, DB &db,
+                      const TleFilter &filter, int64_t when, size_t nThreads,
+                      bool useSIMD) {
+  using Clock = std::chrono::steady_clock;
+  using MSecs = std::chrono::duration<double, std::milli>;
+  MultiSiteLookAngles sats(sites, nThreads, useSIMD);
+  forEachTLEAsOf(db, when, filter,
+                 [&sats](const TleRecord &tle) { sats.add(tle); });
+  const auto start = Clock::now();
+  sats.update(when ? DateTime(when) : DateTime::Now(true));
+  const MSecs elapsed = Clock::now() - start;
+
+  for (size_t s = 0; s < sats.sites(); ++s) {
+    const Site &site = sats.site(s);
+    const auto &order = sats.order(s);
+    std::cout << "[+] Site: " << site.name << " (latitude: " << site.lat
+              << ", longitude: " << site.lon << ", altitude: " << site.alt
+              << ')' << std::endl;
+    size_t count = 0;
+    for (const auto idx : order)
+      std::cout << "[+] [" << (++count) << '/' << order.size() << "] " << '('
+                << sats.tle(idx).name << "): LookAngle: "
+                << sats.lookAngle(s, idx) << std::endl;
+  }
+  std::cout << "[+] Calculated look angles for " << sats.sites()
+            << " sites in " << elapsed.count() << " ms" << std::endl;
+}
+
+// Time loading the catalog from 'db' as TleRecords, and what converting it
+// to libsgp4 Tles (the old in-memory form) would add, and compare the memory
+// used by each form.
+static void benchmarkLoad(DB &db, const TleFilter &filter, int iterations) {
+  using Clock = std::chrono::steady_clock;
+  using MSecs = std::chrono::duration<double, std::milli>;
+  std::vector<TleRecord> recs;
+  auto start = Clock::now();
+  for (int i = 0; i < iterations; ++i)
+    recs = db.fetchTLEs(filter);
+  const MSecs load = Clock::now() - start;
+
+  // Visit the rows without keeping them, as SatLookAngles does.
+  size_t streamed = 0;
+  start = Clock::now();
+  for (int i = 0; i < iterations; ++i)
+    streamed = db.forEachTLE([](const TleRecord &) {}, filter);
+  const MSecs stream = Clock::now() - start;
+
+  std::vector<Tle> tles;
+  start = Clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    tles.clear();
+    for (const auto &rec : recs)
+      tles.push_back(rec.toTle());
+  }
+  const MSecs convert = Clock::now() - start;
+
+  // Strings longer than the small string buffer live on the heap.
+  size_t tleBytes = tles.size() * sizeof(Tle);
+  for (const auto &tle : tles)
+    for (const auto &str : {tle.Name(), tle.Line1(), tle.Line2()})
+      if (str.size() >= sizeof(std::string) / 2)
+        tleBytes += str.size() + 1;
+
+  std::cout << "[+] Load " << recs.size()
+            << " TLEs: " << load.count() / iterations
+            << " ms, converting to libsgp4 Tles adds "
+            << convert.count() / iterations << " ms" << std::endl
+            << "[+] Stream " << streamed
+            << " TLEs: " << stream.count() / iterations
+            << " ms (without building a list)" << std::endl
+            << "[+] Catalog memory: TleRecord: "
+            << recs.size() * sizeof(TleRecord) / 1024.0
+            << " KB, libsgp4 Tle: at least " << tleBytes / 1024.0 << " KB"
+            << std::endl;
+}
+
+// Time building SatLookAngles (the startup of a normal run) from the database
+// and from 'snapshot'.
+static void benchmarkStartup(double lat, double lon, double alt, DB &db,
+                             const CatalogSnapshot &snapshot,
+                             const LookAngleOptions &opts, int iterations) {
+  using Clock = std::chrono::steady_clock;
+  using MSecs = std::chrono::duration<double, std::milli>;
+  size_t fromDB = 0, fromSnapshot = 0;
+  auto start = Clock::now();
+  for (int i = 0; i < iterations; ++i)
+    fromDB = getSatellitesAndLookAngles(lat, lon, alt, db, opts)
+                 .getTLEs()
+                 .size();
+  const MSecs dbTime = Clock::now() - start;
+
+  start = Clock::now();
+  for (int i = 0; i < iterations; ++i)
+    fromSnapshot = getSatellitesAndLookAngles(lat, lon, alt, snapshot, opts)
+                       .getTLEs()
+                       .size();
+  const MSecs snapshotTime = Clock::now() - start;
+
+  std::cout << "[+] Startup from the database: " << fromDB << " TLEs in "
+            << dbTime.count() / iterations << " ms, from the snapshot: "
+            << fromSnapshot << " TLEs in " << snapshotTime.count() / iterations
+            << " ms" << std::endl;
+}
+
+// Time parsing 'fname' with the getline() reader and with the mapped parser,
+// both sequentially and with 'nThreads' threads.
+static void benchmarkParse(const char *fname, int iterations,
+                           size_t nThreads) {
+  using Clock = std::chrono::steady_clock;
+  using MSecs = std::chrono::duration<double, std::milli>;
+  size_t legacyCount = 0, mappedCount = 0, bytes = 0;
+
+  auto start = Clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    FILE *fp = fopen(fname, "r");
+    if (!fp) {
+      std::cerr << "[-] Could not open " << fname << std::endl;
+      return;
+    }
+    legacyCount = readTLEs(fname, fp).size();
+    fclose(fp);
+  }
+  const MSecs legacy = Clock::now() - start;
+
+  start = Clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    const MappedFile file(fname);
+    std::vector<TleRecord> tles;
+    mappedCount = parseTLEs(file.view(), fname, tles);
+    bytes = file.view().size();
+  }
+  const MSecs mapped = Clock::now() - start;
+
+  ThreadPool pool(nThreads);
+  size_t parallelCount = 0;
+  start = Clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    const MappedFile file(fname);
+    std::vector<TleRecord> tles;
+    parallelCount = parseTLEs(file.view(), fname, tles, pool);
+  }
+  const MSecs parallel = Clock::now() - start;
+
+  const double mb = bytes / (1024.0 * 1024.0);
+  std::cout << "[+] Parse (getline): " << legacy.count() / iterations
+            << " ms, " << legacyCount << " TLEs, "
+            << mb * iterations * 1000.0 / legacy.count() << " MB/s"
+            << std::endl
+            << "[+] Parse (mmap):    " << mapped.count() / iterations
+            << " ms, " << mappedCount << " TLEs, "
+            << mb * iterations * 1000.0 / mapped.count() << " MB/s"
+            << std::endl
+            << "[+] Parse (mmap, " << pool.size()
+            << " threads): " << parallel.count() / iterations << " ms, "
+            << parallelCount << " TLEs, "
+            << mb * iterations * 1000.0 / parallel.count() << " MB/s"
+            << std::endl;
+}
+
+// Time storing the TLEs in 'fname' into a scratch database next to 'dbFile',
+// one transaction per row (as SQLite autocommits) and in transactions of
+// 'batchSize'. Row at a time is slow enough that only the first kRowSample
+// records are timed with it.
+static void benchmarkWrite(const char *fname, const char *dbFile,
+                           size_t batchSize) {
+  using Clock = std::chrono::steady_clock;
+  using MSecs = std::chrono::duration<double, std::milli>;
+  constexpr size_t kRowSample = 500;
+  const MappedFile file(fname);
+  if (!file.ok()) {
+    std::cerr << "[-] Could not open " << fname << std::endl;
+    return;
+  }
+  std::vector<TleRecord> tles;
+  parseTLEs(file.view(), fname, tles);
+
+  const std::string scratch = std::string(dbFile) + ".bench";
+  auto timeWrites = [&](size_t count, size_t batch, size_t &written) {
+    std::remove(scratch.c_str());
+    DBSQLite db(scratch.c_str());
+    const auto start = Clock::now();
+    written = db.updateMany(tles.data(), count, batch);
+    return MSecs(Clock::now() - start);
+  };
+
+  size_t rowWritten = 0, batchWritten = 0;
+  const size_t sample = std::min(tles.size(), kRowSample);
+  const MSecs row = timeWrites(sample, 1, rowWritten);
+  const MSecs batched = timeWrites(tles.size(), batchSize, batchWritten);
+  std::remove(scratch.c_str());
+
+  std::cout << "[+] Write (row at a time): " << rowWritten << " TLEs in "
+            << row.count() << " ms, " << rowWritten * 1000.0 / row.count()
+            << " TLEs/s" << std::endl
+            << "[+] Write (" << batchSize
+            << " per transaction): " << batchWritten << " TLEs in "
+            << batched.count() << " ms, "
+            << batchWritten * 1000.0 / batched.count() << " TLEs/s"
+            << std::endl;
+}
+
+// Predict and print the passes of every satellite in the DB that matches
+// 'filter' over the 'hours' after 'when' (DateTime ticks; 0: now), sorted by
+// rise time.
+static void showPasses(double lat, double lon, double alt, DB &db,
+                       const TleFilter &filter, int64_t when, double hours,
+                       size_t nThreads) {
+  using Clock = std::chrono::steady_clock;
+  using MSecs = std::chrono::duration<double, std::milli>;
+  std::vector<TleRecord> tles;
+  forEachTLEAsOf(db, when, filter,
+                 [&tles](const TleRecord &tle) { tles.push_back(tle); });
+  ThreadPool pool(nThreads);
+  const auto start = Clock::now();
+  const auto passes =
+      findPasses(tles, CoordGeodetic(lat, lon, alt),
+                 when ? DateTime(when) : DateTime::Now(true), hours, pool);
+  const MSecs elapsed = Clock::now() - start;
+
+  size_t count = 0;
+  for (const auto &pass : passes)
+    std::cout << "[+] [" << (++count) << '/' << passes.size() << "] " << '('
+              << tles[pass.sat].name << "): AOS: " << pass.aos
+              << " TCA: " << pass.tca << " LOS: " << pass.los
+              << " Max Elevation: "
+              << Util::RadiansToDegrees(pass.maxElevation) << std::endl;
+  std::cout << "[+] Found " << passes.size() << " passes of " << tles.size()
+            << " satellites over " << hours << " hours in "
+            << elapsed.count() << " ms" << std::endl;
+}
+
+// Print the look angles of every satellite in the DB that matches 'filter'
+// at each time of 'grid', in time order, with the steps spread over
+// 'nThreads'. The TLEs are those with the epoch closest to the middle of the
+// grid.
+static void showSweep(double lat, double lon, double alt, DB &db,
+                      const TleFilter &filter, const LookAngleOptions &opts,
+                      const TimeGrid &grid, size_t nThreads) {
+  using Clock = std::chrono::steady_clock;
+  using Secs = std::chrono::duration<double>;
+  const int64_t middle =
+      grid.start.Ticks() + (grid.end.Ticks() - grid.start.Ticks()) / 2;
+  std::vector<TleRecord> tles;
+  db.forEachTLEAt(
+      middle, [&tles](const TleRecord &tle) { tles.push_back(tle); }, filter);
+
+  DisplayConsole disp;
+  const auto start = Clock::now();
+  const size_t steps = sweepLookAngles(
+      tles, lat, lon, alt, opts, grid, nThreads,
+      [&disp](size_t, SatLookAngles &sats) {
+        std::cout << "[+] Time: " << sats.getTime() << " UTC" << std::endl;
+        disp.render(sats);
+      });
+  const Secs elapsed = Clock::now() - start;
+  std::cout << "[+] Calculated look angles for " << tles.size()
+            << " satellites at " << steps << " times in " << elapsed.count()
+            << " seconds" << std::endl;
+}
+
+// Parse a UTC time in ISO 8601 form, "YYYY-MM-DD[Thh:mm[:ss[.s]]][Z]" (a
+// space may stand in for the 'T'), into 'time'. Returns false if malformed.
+static bool parseTime(const char *str, DateTime &time) {
+  int year, month, day, hour = 0, minute = 0, n = 0;
+  double second = 0.0;
+  if (sscanf(str, "%4d-%2d-%2d%n", &year, &month, &day, &n) != 3)
+    return false;
+  str += n;
+  if (*str == 'T' || *str == ' ') {
+    n = 0;
+    if (sscanf(str + 1, "%2d:%2d%n", &hour, &minute, &n) != 2)
+      return false;
+    str += 1 + n;
+    if (*str == ':') {
+      n = 0;
+      if (sscanf(str + 1, "%lf%n", &second, &n) != 1)
+        return false;
+      str += 1 + n;
+    }
+  }
+  if (*str == 'Z')
+    ++str;
+  if (*str || year < 1 || year > 9999 ||
+      !DateTime::IsValidYearMonthDay(year, month, day) || hour < 0 ||
+      hour > 23 || minute < 0 || minute > 59 || !(second >= 0.0) ||
+      second >= 60.0)
+    return false;
+  time = DateTime(year, month, day, hour, minute, 0)
+             .AddMicroseconds(std::round(second * 1e6));
+  return true;
+}
+
+// Set 'filter's NORAD range from "N" or "N-M". Returns false if malformed.
+static bool parseNoradRange(const char *str, TleFilter &filter) {
+  unsigned long first, last;
+  char *end;
+  first = last = std::strtoul(str, &end, 10);
+  if (end == str)
+    return false;
+  if (*end == '-') {
+    const char *second = end + 1;
+    last = std::strtoul(second, &end, 10);
+    if (end == second)
+      return false;
+  }
+  if (*end || first > last || last > UINT32_MAX)
+    return false;
+  filter.minNorad = static_cast<uint32_t>(first);
+  filter.maxNorad = static_cast<uint32_t>(last);
+  return true;
+}
+
 int main(int argc, char **argv) {
   double alt = 0.0, lat = 0.0, lon = 0.0;
-  bool verbose = false, gui = false;
+  bool verbose = false, gui = false, refetch = false;
   const char *sourceFile = nullptr, *dbFile = DEFAULT_DB_PATH;
-  int opt, refreshRate = -1;
-  const char *optStr = "ghva:d:r:u:x:y:";
+  const char *observersFile = nullptr, *parseFile = nullptr;
+  const char *writeFile = nullptr;
+  int opt, refreshRate = -1, benchIterations = 0, nThreads = 1;
+  int maxConnections = 8;
+  long batchSize = DB::kDefaultBatchSize;
+  double passHours = 0.0, sweepStep = 60.0;
+  int64_t sweepStart = 0, sweepEnd = 0; // DateTime ticks (0: not set).
+  LookAngleOptions laOpts;
+  TleFilter filter;
+  const char *optStr =
+      "efghsvzA:D:E:I:N:P:S:T:W:a:b:c:d:i:k:m:n:o:p:r:t:u:w:x:y:";
   while ((opt = getopt_long(argc, argv, optStr, opts, nullptr)) > 0) {
     switch (opt) {
 #if HAVE_GUI
@@ -270,24 +1129,105 @@ int main(int argc, char **argv) {
     case 'h':
       usage(argv[0]);
       break;
+    case 's':
+      laOpts.useSIMD = false;
+      break;
     case 'v':
       verbose = true;
       break;
     case 'a':
       alt = std::stod(optarg);
       break;
+    case 'b':
+      benchIterations = std::stoi(optarg);
+      break;
+    case 'c':
+      maxConnections = std::stoi(optarg);
+      break;
     case 'd':
       dbFile = optarg;
       break;
+    case 'e':
+      laOpts.byElevation = true;
+      break;
+    case 'f':
+      refetch = true;
+      break;
+    case 'A':
+      filter.maxEpochAge = std::stod(optarg);
+      break;
+    case 'I':
+      filter.minInclination = std::stod(optarg);
+      break;
+    case 'i':
+      laOpts.maxInterpError = std::stod(optarg);
+      break;
+    case 'k':
+      laOpts.limit = std::stoul(optarg);
+      break;
+    case 'm':
+      filter.maxPeriod = std::stod(optarg);
+      break;
+    case 'n':
+      filter.name = optarg;
+      break;
+    case 'N':
+      if (!parseNoradRange(optarg, filter)) {
+        std::cerr << "[-] Invalid NORAD number or range: " << optarg
+                  << std::endl;
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'o':
+      observersFile = optarg;
+      break;
+    case 'p':
+      passHours = std::stod(optarg);
+      break;
+    case 'P':
+      parseFile = optarg;
+      break;
+    case 't':
+      nThreads = std::stoi(optarg);
+      break;
+    case 'T':
+    case 'S':
+    case 'E': {
+      DateTime time;
+      if (!parseTime(optarg, time)) {
+        std::cerr << "[-] Invalid time (expected YYYY-MM-DDThh:mm:ssZ): "
+                  << optarg << std::endl;
+        return EXIT_FAILURE;
+      }
+      if (opt == 'T')
+        laOpts.time = time.Ticks();
+      else if (opt == 'S')
+        sweepStart = time.Ticks();
+      else
+        sweepEnd = time.Ticks();
+      break;
+    }
+    case 'D':
+      sweepStep = std::stod(optarg);
+      break;
     case 'u':
       sourceFile = optarg;
       break;
+    case 'w':
+      batchSize = std::stol(optarg);
+      break;
+    case 'W':
+      writeFile = optarg;
+      break;
     case 'x':
       lat = std::stod(optarg);
       break;
     case 'y':
       lon = std::stod(optarg);
       break;
+    case 'z':
+      laOpts.horizonFilter = true;
+      break;
     default:
       std::cerr << "[-] Unknown command line option." << std::endl;
       exit(EXIT_FAILURE);
@@ -295,6 +1235,48 @@ int main(int argc, char **argv) {
     }
   }
 
+  if (nThreads < 1) {
+    std::cerr << "[-] The number of threads must be at least 1." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (maxConnections < 1) {
+    std::cerr << "[-] The number of connections must be at least 1."
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (batchSize < 1) {
+    std::cerr << "[-] The batch size must be at least 1." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  TimeGrid grid;
+  if (sweepEnd) {
+    const int64_t first = sweepStart ? sweepStart : laOpts.time;
+    grid.start = first ? DateTime(first) : DateTime::Now(true);
+    grid.end = DateTime(sweepEnd);
+    grid.stepSecs = sweepStep;
+    if (grid.stepTicks() <= 0 || grid.steps() == 0) {
+      std::cerr << "[-] The step must be positive and the end must not be "
+                << "before the start." << std::endl;
+      return EXIT_FAILURE;
+    }
+  } else if (sweepStart) {
+    std::cerr << "[-] --start needs --end." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (writeFile) {
+    benchmarkWrite(writeFile, dbFile, batchSize);
+    return 0;
+  }
+
+  if (parseFile) {
+    benchmarkParse(parseFile, std::max(benchIterations, 1), nThreads);
+    return 0;
+  }
+
   // Ensure we have valid coords.
   if (lat > 90.0 || lat < -90.0 || lon > 180.0 || lon < -180.0) {
     std::cerr << "[-] Invalid coordinates (latitude: " << lat
@@ -304,6 +1286,9 @@ int main(int argc, char **argv) {
   std::cout << "[+] Using viewer position (latitude: " << lat
             << ", longitude: " << lon << ", "
             << ", altitude: " << alt << ')' << std::endl;
+  if (laOpts.time)
+    std::cout << "[+] Using time: " << DateTime(laOpts.time) << " UTC"
+              << std::endl;
 
   // Open the database that contains the TLE data.
   if (!dbFile) {
@@ -321,11 +1306,62 @@ int main(int argc, char **argv) {
   }
 
   // If a source file is specified, then update the existing database.
-  if (sourceFile)
-    update(sourceFile, db, verbose);
+  const std::string snapPath = snapshotPath(dbFile);
+  if (sourceFile) {
+    update(sourceFile, db, verbose, nThreads, maxConnections, refetch,
+           batchSize);
+    refreshSnapshot(db, snapPath);
+  }
+
+  if (observersFile) {
+    std::vector<Site> sites;
+    std::string error;
+    if (!readSites(observersFile, sites, error)) {
+      std::cerr << "[-] " << error << std::endl;
+      return EXIT_FAILURE;
+    }
+    showSites(sites, db, filter, laOpts.time, nThreads, laOpts.useSIMD);
+    return 0;
+  }
+
+  if (passHours > 0.0) {
+    showPasses(lat, lon, alt, db, filter, laOpts.time, passHours, nThreads);
+    return 0;
+  }
+
+  if (sweepEnd) {
+    showSweep(lat, lon, alt, db, filter, laOpts, grid, nThreads);
+    return 0;
+  }
 
   // Calculate and display.
-  auto TLEsAndLAs = getSatellitesAndLookAngles(lat, lon, alt, db);
+  laOpts.nThreads = nThreads;
+  // Start from the snapshot if it matches the database. It holds the whole
+  // current catalog, so filtered runs and runs at another time still query
+  // the database.
+  const CatalogSnapshot snapshot(snapPath);
+  const bool useSnapshot = filter.selectsAll() && !laOpts.time &&
+                           snapshot.ok() &&
+                           snapshot.generation() == db.generation();
+  if (verbose)
+    std::cout << "[+] Loading TLEs from the "
+              << (useSnapshot ? "snapshot" : "database") << std::endl;
+  auto TLEsAndLAs =
+      useSnapshot
+          ? getSatellitesAndLookAngles(lat, lon, alt, snapshot, laOpts)
+          : getSatellitesAndLookAngles(lat, lon, alt, db, laOpts, filter);
+  if (benchIterations > 0) {
+    // The benchmarks run at the time of the look angles, so with --time the
+    // inputs are the same from run to run.
+    benchmark(TLEsAndLAs, benchIterations);
+    benchmarkBatch(TLEsAndLAs, benchIterations);
+    benchmarkEphemeris(TLEsAndLAs, benchIterations);
+    benchmarkLoad(db, filter, benchIterations);
+    if (useSnapshot)
+      benchmarkStartup(lat, lon, alt, db, snapshot, laOpts, benchIterations);
+    return 0;
+  }
+
   if (gui) {
     DisplayNCurses disp(refreshRate);
     disp.render(TLEsAndLAs);
@@ -18,11 +18,21 @@
 #define __SATNOW_MAIN_HH
 
 #include "db.hh"
+#include "ephemeris.hh"
+#include "horizon.hh"
+#include "lookangle.hh"
+#include "sgp4batch.hh"
+#include "snapshot.hh"
+#include "threadpool.hh"
+#include "tlerecord.hh"
 #include <CoordTopocentric.h>
+#include <CoordGeodetic.h>
 #include <DateTime.h>
-#include <Observer.h>
 #include <SGP4.h>
 #include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
 
 // Version info. Excuse the ugly trick to get strigification for a macro value.
 #define MAJOR 0
@@ -32,59 +42,224 @@
 #define _VER(_x, _y, _z) _VER2(_x, _y, _z)
 #define VER _VER(MAJOR, MINOR, PATCH)
 
-// TLE and look angle pair.
-using SatLookAngle = std::pair<Tle, CoordTopocentric>;
+// A view of one satellite: its TLE and its look angle.
+// The TLE lives in the cold table of SatLookAngles and the look angle is
+// assembled from the hot arrays, so views are cheap to create and should not
+// outlive the container they came from. A stale look angle is one that was
+// not recalculated on the last refresh because the satellite was known to be
+// below the horizon (see LookAngleOptions::horizonFilter).
+struct SatLookAngle {
+  const TleRecord &first;
+  const CoordTopocentric second;
+  const bool stale;
+};
+
+// Settings for how SatLookAngles calculates look angles.
+struct LookAngleOptions {
+  size_t nThreads = 1;        // Threads used to refresh look angles.
+  bool useSIMD = true;        // Use the vectorized propagator if supported.
+  bool horizonFilter = false; // Skip satellites that can't be above horizon.
+  double maxInterpError = 0.0; // Interpolation error bound in km (0: off).
+  size_t limit = 0;           // Only keep the best 'limit' rows (0: all).
+  bool byElevation = false;   // Order by elevation (highest first).
+  int64_t time = 0;           // Evaluate at this time (DateTime ticks)
+                              // rather than now (0: now).
+};
+
+// How often each path of SatLookAngles::sort() was taken.
+struct SortStats {
+  size_t sorted = 0;    // The order was already sorted.
+  size_t insertion = 0; // Repaired by insertion sort.
+  size_t full = 0;      // Too much disorder; fell back to std::sort.
+  size_t topK = 0;      // Selected only the best LookAngleOptions::limit.
+};
 
 // Container class for holding Tle and look angles.
+// Storage is split in two: the cold table (_tles, _models) holds per-satellite
+// data that is only read when propagating or displaying, and the hot arrays
+// (_az, _el, _range, _rate) hold the look angles that are rewritten on every
+// refresh. All of these are indexed by the satellite's insertion index and are
+// never reordered. Sorting only permutes _order, which maps a display row to a
+// satellite index.
+//
+// When the CPU has SIMD support, near-earth satellites are also added to
+// _batch and refreshed with the vectorized propagator; deep-space satellites
+// (and any that the batch can't handle) use their libsgp4 model.
+//
+// With the horizon filter enabled, a satellite found below the horizon is not
+// propagated again until the earliest time it could rise (_nextExact); until
+// then its look angle is kept and flagged as stale. Batched satellites are
+// skipped a SIMD block at a time, so a block is propagated whenever any of its
+// satellites is due.
+//
+// With interpolation enabled (LookAngleOptions::maxInterpError), refreshes
+// read positions from an EphemerisCache fit in the background, and only fall
+// back to propagating when the cache has no span for the current time.
+//
+// Satellites can also be added from a CatalogSnapshot, which holds what add()
+// would otherwise compute. The libsgp4 model of a satellite added that way is
+// only built once it is needed, which for a batched satellite is only if the
+// batch can't propagate it.
 class SatLookAngles {
 private:
   double _lat, _lon, _alt;
-  std::vector<SatLookAngle> _sats;
-  Observer _me;
+  std::vector<TleRecord> _tles;
+  // Propagator for each _tles entry (built on first use, see model()).
+  std::vector<std::unique_ptr<SGP4>> _models;
+  std::vector<double> _az, _el, _range, _rate;
+  std::vector<int64_t> _nextExact; // Ticks when the satellite is next due.
+  std::vector<uint8_t> _stale;     // Look angle was not refreshed.
+  std::vector<uint32_t> _order;    // Row to satellite index.
+  SGP4Batch _batch;
+  std::vector<uint32_t> _batchSats;  // Batch slot to satellite index.
+  std::vector<uint32_t> _scalarSats; // Satellites not in _batch.
+  LookAngleOptions _opts;
+  bool _useBatch;
+  HorizonFilter _filter;
+  LookAngleTransform _view; // Observer state at _time.
   DateTime _time;
+  std::unique_ptr<ThreadPool> _pool; // Used to propagate in parallel.
+  std::unique_ptr<EphemerisCache> _ephemeris; // Built on first refresh.
+  SortStats _sortStats;
 
-public:
-  SatLookAngles(double lat, double lon, double alt)
-      : _me(lat, lon, alt), _time(DateTime::Now(true)) {}
-
-  // Add the tle to the _sats container, and also
-  // generate the look angle at _time.
-  void add(Tle tle) {
-    const auto model = SGP4(tle);
-    const auto pos = model.FindPosition(_time);
-    const auto la = _me.GetLookAngle(pos);
-    _sats.emplace_back(tle, la);
+  void setTime(const DateTime &time) {
+    _time = time;
+    _view.setTime(time);
   }
 
-  // Regenerate new look angles with the current time.
-  void updateTimeAndPositions() {
-    _time = DateTime::Now(true);
-    for (auto &sat : _sats) {
-      const auto model = SGP4(sat.first);
-      const auto pos = model.FindPosition(_time);
-      sat.second = _me.GetLookAngle(pos);
-    }
+  void setLookAngle(size_t idx, const CoordTopocentric &la) {
+    _az[idx] = la.azimuth;
+    _el[idx] = la.elevation;
+    _range[idx] = la.range;
+    _rate[idx] = la.range_rate;
+  }
+
+  // Decide when satellite 'idx', now at ECI 'pos', next needs propagating.
+  void schedule(size_t idx, const Vector &pos) {
+    _stale[idx] = 0;
+    if (_opts.horizonFilter && _el[idx] < 0.0)
+      _nextExact[idx] = _filter.earliestRise(
+          idx, pos, _view.getObserverPosition(), _time.Ticks());
+  }
+
+  // Satellite 'idx's libsgp4 model. Satellites are only ever refreshed by
+  // the thread whose chunk they are in, so building the model is not racy.
+  const SGP4 &model(size_t idx) {
+    if (!_models[idx])
+      _models[idx].reset(new SGP4(_tles[idx].toTle()));
+    return *_models[idx];
   }
 
-  // Sort the satellites based on range (closest to furthest).
-  void sort() {
-    std::sort(_sats.begin(), _sats.end(),
-              [](const SatLookAngle &a, const SatLookAngle &b) {
-                return a.second.range < b.second.range;
-              });
+  // Propagate satellite 'idx' to _time and store its look angle.
+  void updateLookAngle(size_t idx) {
+    const auto eci = model(idx).FindPosition(_time);
+    setLookAngle(idx, _view.lookAngle(eci.Position(), eci.Velocity()));
+    schedule(idx, eci.Position());
   }
 
-  std::vector<SatLookAngle>::iterator begin() { return _sats.begin(); }
-  std::vector<SatLookAngle>::iterator end() { return _sats.end(); }
-  size_t size() const { return _sats.size(); }
-  SatLookAngle &operator[](size_t index) {
+  size_t addStorage(const TleRecord &rec);
+  void updateBatch(size_t beginBlock, size_t endBlock);
+  void updateInterpolated(const EphemerisSpan &span, size_t begin,
+                          size_t end);
+  template <typename Better> void sortBy(Better better);
+  template <typename Better> void selectBest(Better better);
+
+public:
+  SatLookAngles(double lat, double lon, double alt,
+                const LookAngleOptions &opts = LookAngleOptions())
+      : _opts(opts), _useBatch(opts.useSIMD && SGP4Batch::bestKernel() !=
+                                                    SGP4Batch::Kernel::Generic),
+        _filter(Util::DegreesToRadians(lat)),
+        _view(CoordGeodetic(lat, lon, alt)), _time(_view.getTime()),
+        _pool(new ThreadPool(std::max<size_t>(opts.nThreads, 1))) {
+    if (_opts.time)
+      setTime(DateTime(_opts.time));
+  }
+
+  // Add the tle to the container, and also generate the look angle at _time.
+  // The SGP4 model is built once here and reused by every refresh; this is
+  // the only place the record is converted to a libsgp4 Tle.
+  void add(const TleRecord &rec);
+
+  // Add a satellite from a snapshot. Nothing is propagated: its look angle is
+  // calculated by the next updateTimeAndPositions().
+  void add(const SnapshotRecord &rec);
+
+  // Regenerate new look angles with the current time (or with
+  // LookAngleOptions::time, if set).
+  void updateTimeAndPositions();
+
+  // Regenerate new look angles for 'time'.
+  // The observer frame is computed once for 'time' and shared by all threads.
+  // Each thread handles a contiguous chunk of satellites (whole SIMD blocks
+  // for the batch), so the results do not depend on the number of threads.
+  // The horizon filter and the interpolation cache assume that time moves
+  // forward from one call to the next.
+  void updatePositions(const DateTime &time);
+
+  // The time of the current look angles.
+  const DateTime &getTime() const { return _time; }
+
+  // Every satellite, in insertion order. Unlike the rows, this is not cut
+  // short by LookAngleOptions::limit.
+  const std::vector<TleRecord> &getTLEs() const { return _tles; }
+
+  // Sort the satellites based on range (closest to furthest), or elevation
+  // (highest first) if LookAngleOptions::byElevation is set.
+  // Look angles change little between refreshes, so the previous order is
+  // usually nearly sorted: sort() repairs it with an insertion sort, and only
+  // falls back to a full sort once the insertion sort has moved more than
+  // kSortMovesPerSat elements per satellite.
+  // With LookAngleOptions::limit set, only the best 'limit' satellites are
+  // kept as rows: each thread keeps a bounded heap of the best satellites in
+  // its chunk, and the heaps are merged, which is O(n log limit).
+  void sort();
+  static constexpr size_t kSortMovesPerSat = 4;
+
+  // How often each path of sort() was taken.
+  const SortStats &getSortStats() const { return _sortStats; }
+
+  // Forward iterator over the rows, in sorted order, yielding views.
+  class iterator {
+  private:
+    const SatLookAngles *_sats;
+    size_t _row;
+
+  public:
+    iterator(const SatLookAngles *sats, size_t row) : _sats(sats), _row(row) {}
+    SatLookAngle operator*() const { return (*_sats)[_row]; }
+    iterator &operator++() {
+      ++_row;
+      return *this;
+    }
+    bool operator==(const iterator &other) const { return _row == other._row; }
+    bool operator!=(const iterator &other) const { return _row != other._row; }
+  };
+
+  iterator begin() const { return iterator(this, 0); }
+  iterator end() const { return iterator(this, size()); }
+  size_t size() const { return _order.size(); }
+  SatLookAngle operator[](size_t index) const {
     assert(index < size() && "Invalid index.");
-    return _sats[index];
+    const size_t idx = _order[index];
+    return {_tles[idx],
+            CoordTopocentric(_az[idx], _el[idx], _range[idx], _rate[idx]),
+            _stale[idx] != 0};
   }
 };
 
-// Queries the DB for TLE entries, and generates a container of TLEs and their
-// look angles with respect to lat/lon/alt.
-SatLookAngles getSatellitesAndLookAngles(double lat, double lon, double alt,
-                                         DB &db);
+// Queries the DB for TLE entries matching 'filter', and generates a container
+// of TLEs and their look angles with respect to lat/lon/alt.
+// With LookAngleOptions::time set, each satellite's element set is the one in
+// the history closest to that time (see DB::forEachTLEAt()).
+SatLookAngles
+getSatellitesAndLookAngles(double lat, double lon, double alt, DB &db,
+                           const LookAngleOptions &opts = LookAngleOptions(),
+                           const TleFilter &filter = TleFilter());
+
+// As above, but for every TLE in 'snapshot'.
+SatLookAngles
+getSatellitesAndLookAngles(double lat, double lon, double alt,
+                           const CatalogSnapshot &snapshot,
+                           const LookAngleOptions &opts = LookAngleOptions());
 #endif // __SATNOW_MAIN_HH
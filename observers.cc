@@ -0,0 +1,147 @@
+// satnow: observers.cc
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "observers.hh"
+#include <CoordGeodetic.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+bool readSites(const std::string &fname, std::vector<Site> &sites,
+               std::string &error) {
+  std::ifstream in(fname);
+  if (!in) {
+    error = "Could not open '" + fname + "'";
+    return false;
+  }
+  std::string line;
+  for (size_t lineNo = 1; std::getline(in, line); ++lineNo) {
+    const auto comment = line.find('#');
+    if (comment != std::string::npos)
+      line.erase(comment);
+    std::istringstream ss(line);
+    Site site = {"", 0.0, 0.0, 0.0};
+    if (!(ss >> site.name))
+      continue; // Blank line.
+    if (!(ss >> site.lat >> site.lon >> site.alt) || site.lat > 90.0 ||
+        site.lat < -90.0 || site.lon > 180.0 || site.lon < -180.0) {
+      error = fname + ':' + std::to_string(lineNo) +
+              ": Expected: name latitude longitude altitude";
+      return false;
+    }
+    sites.push_back(site);
+  }
+  return true;
+}
+
+MultiSiteLookAngles::MultiSiteLookAngles(const std::vector<Site> &sites,
+                                         size_t nThreads, bool useSIMD)
+    : _sites(sites), _useBatch(useSIMD && SGP4Batch::bestKernel() !=
+                                              SGP4Batch::Kernel::Generic),
+      _az(sites.size()), _el(sites.size()), _range(sites.size()),
+      _rate(sites.size()), _order(sites.size()),
+      _pool(new ThreadPool(std::max<size_t>(nThreads, 1))) {
+  for (const auto &site : _sites)
+    _views.emplace_back(CoordGeodetic(site.lat, site.lon, site.alt));
+}
+
+void MultiSiteLookAngles::add(const TleRecord &rec) {
+  const size_t idx = _tles.size();
+  const Tle tle = rec.toTle();
+  _models.emplace_back(tle);
+  _tles.push_back(rec);
+  _identity.push_back(static_cast<uint32_t>(idx));
+  for (auto *v : {&_x, &_y, &_z, &_vx, &_vy, &_vz})
+    v->push_back(0.0);
+  _valid.push_back(0);
+  for (size_t s = 0; s < _sites.size(); ++s) {
+    _az[s].push_back(0.0);
+    _el[s].push_back(0.0);
+    _range[s].push_back(0.0);
+    _rate[s].push_back(0.0);
+  }
+  if (_useBatch && SGP4Batch::isNearEarth(tle)) {
+    _batch.add(tle);
+    _batchSats.push_back(static_cast<uint32_t>(idx));
+  } else
+    _scalarSats.push_back(static_cast<uint32_t>(idx));
+}
+
+// Propagate satellite 'idx' with libsgp4.
+void MultiSiteLookAngles::propagate(size_t idx, const DateTime &when) {
+  try {
+    const auto eci = _models[idx].FindPosition(when);
+    const Vector &pos = eci.Position(), &vel = eci.Velocity();
+    _x[idx] = pos.x;
+    _y[idx] = pos.y;
+    _z[idx] = pos.z;
+    _vx[idx] = vel.x;
+    _vy[idx] = vel.y;
+    _vz[idx] = vel.z;
+    _valid[idx] = 1;
+  } catch (...) {
+    _valid[idx] = 0; // E.g., the satellite has decayed.
+  }
+}
+
+void MultiSiteLookAngles::update(const DateTime &when) {
+  // Propagate once for all sites.
+  _pool->parallelFor(_batch.blocks(), [&](size_t begin, size_t end) {
+    _batch.propagate(when, begin, end);
+    const size_t last = std::min(end * SGP4Batch::kBlock, _batch.size());
+    for (size_t slot = begin * SGP4Batch::kBlock; slot < last; ++slot) {
+      const size_t idx = _batchSats[slot];
+      if (!_batch.valid(slot)) {
+        propagate(idx, when); // Let libsgp4 decide.
+        continue;
+      }
+      _x[idx] = _batch.output(SGP4Batch::X)[slot];
+      _y[idx] = _batch.output(SGP4Batch::Y)[slot];
+      _z[idx] = _batch.output(SGP4Batch::Z)[slot];
+      _vx[idx] = _batch.output(SGP4Batch::VX)[slot];
+      _vy[idx] = _batch.output(SGP4Batch::VY)[slot];
+      _vz[idx] = _batch.output(SGP4Batch::VZ)[slot];
+      _valid[idx] = 1;
+    }
+  });
+  _pool->parallelFor(_scalarSats.size(), [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i)
+      propagate(_scalarSats[i], when);
+  });
+
+  // Then transform into each site's frame and sort.
+  for (size_t s = 0; s < _sites.size(); ++s) {
+    auto &view = _views[s];
+    view.setTime(when);
+    const LookAngleArrays out = {_az[s].data(), _el[s].data(),
+                                 _range[s].data(), _rate[s].data()};
+    _pool->parallelFor(_tles.size(), [&](size_t begin, size_t end) {
+      const EciArrays eci = {_x.data() + begin,  _y.data() + begin,
+                             _z.data() + begin,  _vx.data() + begin,
+                             _vy.data() + begin, _vz.data() + begin};
+      view.lookAngles(end - begin, eci, _identity.data() + begin, out);
+    });
+
+    auto &order = _order[s];
+    order.clear();
+    for (size_t idx = 0; idx < _tles.size(); ++idx)
+      if (_valid[idx])
+        order.push_back(static_cast<uint32_t>(idx));
+    const double *range = _range[s].data();
+    std::sort(order.begin(), order.end(),
+              [range](uint32_t a, uint32_t b) { return range[a] < range[b]; });
+  }
+}
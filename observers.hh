@@ -0,0 +1,92 @@
+// satnow: observers.hh
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __SATNOW_OBSERVERS_HH
+#define __SATNOW_OBSERVERS_HH
+#include "lookangle.hh"
+#include "sgp4batch.hh"
+#include "threadpool.hh"
+#include "tlerecord.hh"
+#include <CoordTopocentric.h>
+#include <DateTime.h>
+#include <SGP4.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// An observer (ground station), in the same units as --lat, --lon and --alt.
+struct Site {
+  std::string name;
+  double lat, lon, alt;
+};
+
+// Read sites from 'fname', one per line as: name lat lon alt
+// Blank lines and anything after a '#' are ignored. Returns false, with a
+// message in 'error', if the file can't be read or a line is malformed.
+bool readSites(const std::string &fname, std::vector<Site> &sites,
+               std::string &error);
+
+// Look angles of one catalog from many sites.
+//
+// update() propagates each satellite once (with the vectorized propagator
+// when possible) into per-satellite ECI arrays, and each site's look angles
+// are then only a LookAngleTransform of those arrays. Propagation therefore
+// costs the same for one site or a hundred.
+class MultiSiteLookAngles {
+private:
+  std::vector<Site> _sites;
+  std::vector<LookAngleTransform> _views; // One per site.
+  std::vector<TleRecord> _tles;
+  std::vector<SGP4> _models;
+  SGP4Batch _batch;
+  bool _useBatch;
+  std::vector<uint32_t> _batchSats;  // Batch slot to satellite index.
+  std::vector<uint32_t> _scalarSats; // Satellites not in _batch.
+  std::vector<uint32_t> _identity;   // i -> i, for LookAngleTransform.
+  std::vector<double> _x, _y, _z, _vx, _vy, _vz; // ECI of each satellite.
+  std::vector<uint8_t> _valid; // libsgp4 did not reject the satellite.
+  // Look angles and the satellites sorted by range, per site.
+  std::vector<std::vector<double>> _az, _el, _range, _rate;
+  std::vector<std::vector<uint32_t>> _order;
+  std::unique_ptr<ThreadPool> _pool;
+
+  void propagate(size_t idx, const DateTime &when);
+
+public:
+  MultiSiteLookAngles(const std::vector<Site> &sites, size_t nThreads,
+                      bool useSIMD);
+
+  // Add a satellite. Throws, as libsgp4 does, if its elements are invalid.
+  void add(const TleRecord &rec);
+
+  // Propagate every satellite to 'when' and compute all sites' look angles.
+  void update(const DateTime &when);
+
+  size_t sites() const { return _sites.size(); }
+  const Site &site(size_t s) const { return _sites[s]; }
+  const TleRecord &tle(size_t idx) const { return _tles[idx]; }
+
+  // Satellite indices for site 's' sorted by range (closest to furthest).
+  // Satellites that libsgp4 could not propagate are left out.
+  const std::vector<uint32_t> &order(size_t s) const { return _order[s]; }
+  CoordTopocentric lookAngle(size_t s, size_t idx) const {
+    return CoordTopocentric(_az[s][idx], _el[s][idx], _range[s][idx],
+                            _rate[s][idx]);
+  }
+};
+
+#endif // __SATNOW_OBSERVERS_HH
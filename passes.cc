@@ -0,0 +1,176 @@
+// satnow: passes.cc
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "passes.hh"
+#include "lookangle.hh"
+#include <Globals.h>
+#include <OrbitalElements.h>
+#include <SGP4.h>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <mutex>
+
+// Coarse steps are a fraction of the orbital period, within these limits.
+static const double kStepsPerOrbit = 100.0;
+static const double kMinStepSecs = 10.0, kMaxStepSecs = 300.0;
+
+// Times are refined to this precision.
+static const double kRootTolSecs = 0.5, kMaxTolSecs = 1.0;
+
+// A local elevation maximum between two coarse samples that are both below
+// the horizon is only searched for a grazing pass if the middle sample is
+// within this much of the horizon.
+static const double kGrazeRadians = 5.0 * kPI / 180.0;
+
+namespace {
+// Elevation of one satellite as a function of seconds since the start time.
+class ElevationFn {
+private:
+  SGP4 _model;
+  LookAngleTransform _view;
+  DateTime _start;
+
+public:
+  ElevationFn(const Tle &tle, const CoordGeodetic &geo, const DateTime &start)
+      : _model(tle), _view(geo), _start(start) {}
+
+  DateTime time(double secs) const { return _start.AddSeconds(secs); }
+
+  double operator()(double secs) {
+    const DateTime when = time(secs);
+    _view.setTime(when);
+    const auto eci = _model.FindPosition(when);
+    return _view.lookAngle(eci.Position(), eci.Velocity()).elevation;
+  }
+};
+} // namespace
+
+// Bisect the horizon crossing in [lo, hi]. 'rising' is true if the satellite
+// is below the horizon at 'lo' and above it at 'hi'.
+static double findCrossing(ElevationFn &el, double lo, double hi,
+                           bool rising) {
+  while (hi - lo > kRootTolSecs) {
+    const double mid = 0.5 * (lo + hi);
+    if ((el(mid) >= 0.0) == rising)
+      hi = mid;
+    else
+      lo = mid;
+  }
+  return 0.5 * (lo + hi);
+}
+
+// Golden section search for the elevation maximum in [lo, hi].
+static double findMaximum(ElevationFn &el, double lo, double hi) {
+  const double r = 0.5 * (std::sqrt(5.0) - 1.0);
+  double a = hi - r * (hi - lo), b = lo + r * (hi - lo);
+  double ea = el(a), eb = el(b);
+  while (hi - lo > kMaxTolSecs) {
+    if (ea < eb) {
+      lo = a;
+      a = b;
+      ea = eb;
+      b = lo + r * (hi - lo);
+      eb = el(b);
+    } else {
+      hi = b;
+      b = a;
+      eb = ea;
+      a = hi - r * (hi - lo);
+      ea = el(a);
+    }
+  }
+  return 0.5 * (lo + hi);
+}
+
+// Append the passes of satellite 'idx' within [0, window] seconds to 'out'.
+static void findSatPasses(size_t idx, const Tle &tle, const CoordGeodetic &geo,
+                          const DateTime &start, double window,
+                          std::vector<Pass> &out) {
+  std::unique_ptr<ElevationFn> elPtr;
+  double step;
+  try {
+    elPtr.reset(new ElevationFn(tle, geo, start));
+    const double period = OrbitalElements(tle).Period() * 60.0;
+    step = std::max(kMinStepSecs,
+                    std::min(kMaxStepSecs, period / kStepsPerOrbit));
+  } catch (...) {
+    return; // libsgp4 can't model this satellite.
+  }
+  ElevationFn &el = *elPtr;
+
+  auto addPass = [&](double aos, double los) {
+    const double tca = findMaximum(el, aos, los);
+    out.push_back({idx, el.time(aos), el.time(tca), el.time(los), el(tca)});
+  };
+
+  // Walk the window, keeping the last three samples: (t0, e0) is the
+  // previous sample and (tp, ep) the one before it.
+  try {
+    double t0 = 0.0, e0 = el(t0), tp = 0.0, ep = e0;
+    bool up = e0 >= 0.0;
+    double aos = 0.0;
+    while (t0 < window) {
+      const double t1 = std::min(t0 + step, window);
+      const double e1 = el(t1);
+      if (!up && e1 >= 0.0) {
+        aos = findCrossing(el, t0, t1, true);
+        up = true;
+      } else if (up && e1 < 0.0) {
+        addPass(aos, findCrossing(el, t0, t1, false));
+        up = false;
+      } else if (!up && t0 > tp && e0 > ep && e0 > e1 && e0 > -kGrazeRadians) {
+        // Both neighbors are lower: look for a short pass between samples.
+        const double tca = findMaximum(el, tp, t1);
+        if (el(tca) >= 0.0)
+          addPass(findCrossing(el, tp, tca, true),
+                  findCrossing(el, tca, t1, false));
+      }
+      tp = t0;
+      ep = e0;
+      t0 = t1;
+      e0 = e1;
+    }
+    if (up)
+      addPass(aos, window);
+  } catch (...) {
+    // The satellite decayed or libsgp4 rejected it part way; keep what we
+    // found up to that point.
+  }
+}
+
+std::vector<Pass> findPasses(const std::vector<TleRecord> &tles,
+                             const CoordGeodetic &geo, const DateTime &start,
+                             double hours, ThreadPool &pool) {
+  std::vector<Pass> passes;
+  std::mutex lock;
+  const double window = hours * 3600.0;
+  pool.parallelFor(tles.size(), [&](size_t begin, size_t end) {
+    std::vector<Pass> found;
+    for (size_t i = begin; i < end; ++i)
+      findSatPasses(i, tles[i].toTle(), geo, start, window, found);
+    std::lock_guard<std::mutex> lk(lock);
+    passes.insert(passes.end(), found.begin(), found.end());
+  });
+
+  // Sort by AOS, breaking ties by satellite so the order is deterministic.
+  std::sort(passes.begin(), passes.end(), [](const Pass &a, const Pass &b) {
+    if (a.aos != b.aos)
+      return a.aos < b.aos;
+    return a.sat < b.sat;
+  });
+  return passes;
+}
@@ -0,0 +1,45 @@
+// satnow: passes.hh
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __SATNOW_PASSES_HH
+#define __SATNOW_PASSES_HH
+#include "threadpool.hh"
+#include "tlerecord.hh"
+#include <CoordGeodetic.h>
+#include <DateTime.h>
+#include <vector>
+
+// A pass of a satellite over the observer: acquisition of signal (rise),
+// time of closest approach (culmination), and loss of signal (set).
+// Passes already in progress at the start of the window, or still in progress
+// at the end of it, have their AOS or LOS clamped to the window.
+struct Pass {
+  size_t sat; // Index of the satellite in the TLE list given to findPasses.
+  DateTime aos, tca, los;
+  double maxElevation; // Elevation at TCA (radians).
+};
+
+// Find the passes of every satellite in 'tles' over the observer at 'geo'
+// (libsgp4 convention: radians and km), between 'start' and 'hours' later.
+// Each satellite is stepped coarsely (relative to its orbital period) to
+// bracket the passes, and the rise, culmination, and set times are then
+// refined by root finding. Satellites are processed in parallel on 'pool'.
+// The result is sorted by AOS.
+std::vector<Pass> findPasses(const std::vector<TleRecord> &tles,
+                             const CoordGeodetic &geo, const DateTime &start,
+                             double hours, ThreadPool &pool);
+
+#endif // __SATNOW_PASSES_HH
@@ -0,0 +1,343 @@
+// satnow: pipeline.cc
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pipeline.hh"
+#include "boundedqueue.hh"
+#include "tleparser.hh"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+using Secs = std::chrono::duration<double>;
+
+// A piece of a source's content.
+struct Chunk {
+  size_t source;
+  std::string data;
+  bool last; // No more of this source follows.
+  bool keep; // With 'last', for a URL: the transfer completed and the
+             // content has changed.
+};
+using Batch = std::vector<TleRecord>;
+
+// Sizes of the pieces passed between stages, and how many of them may wait
+// in each queue. At most about 2 MB of text per parser, and 4 MB of records,
+// are held in the queues, plus one batch per source being parsed.
+constexpr size_t kChunkBytes = 256 * 1024;
+constexpr size_t kChunksPerParser = 8;
+constexpr size_t kBatchRecords = 1024;
+constexpr size_t kQueuedBatches = 16;
+
+// A source being parsed, and the records parsed from it but not yet sent.
+// A file's records are sent on as each batch fills: update() has already
+// checked that the file changed. A URL's records are spilled to a temporary
+// file instead, and only sent on once the transfer has ended, as one that
+// fails part way, or turns out to be unchanged, must not be written.
+struct ActiveSource {
+  Batch batch;           // Being filled by the parser.
+  FILE *spill = nullptr; // A URL's records, if any.
+  bool spillFailed = false;
+  TleStreamParser parser;
+  explicit ActiveSource(const std::string &name) : parser(name, batch) {}
+  ~ActiveSource() {
+    if (spill)
+      fclose(spill);
+  }
+  ActiveSource(const ActiveSource &) = delete;
+  ActiveSource &operator=(const ActiveSource &) = delete;
+
+  // Move the parsed records to the spill file.
+  void hold() {
+    if (!spill && !spillFailed)
+      spill = tmpfile();
+    if (!spill || fwrite(batch.data(), sizeof(TleRecord), batch.size(),
+                         spill) != batch.size())
+      spillFailed = true;
+    batch.clear();
+  }
+
+  // Pass the spilled records to 'send', kBatchRecords at a time. Returns
+  // false if they could not all be spilled or read back.
+  template <typename Send> bool release(Send send) {
+    if (!spill)
+      return !spillFailed;
+    if (spillFailed || fflush(spill) || fseek(spill, 0, SEEK_SET))
+      return false;
+    for (;;) {
+      Batch records(kBatchRecords);
+      records.resize(
+          fread(records.data(), sizeof(TleRecord), records.size(), spill));
+      if (records.empty())
+        break;
+      send(std::move(records));
+    }
+    return !ferror(spill);
+  }
+};
+} // namespace
+
+// Read the files in 'sources' in pieces of kChunkBytes.
+static void readFiles(const std::vector<UpdateSource> &sources,
+                      std::vector<FetchResult> &results,
+                      const std::function<void(Chunk)> &send) {
+  for (size_t i = 0; i < sources.size(); ++i) {
+    if (!sources[i].isFile)
+      continue;
+    const auto start = Clock::now();
+    FetchResult &res = results[i];
+    std::ifstream in(sources[i].name, std::ios::binary);
+    res.state = sources[i].state;
+    if (!in)
+      res.error = "Could not open the file";
+    while (in) {
+      std::string data(kChunkBytes, '\0');
+      in.read(&data[0], data.size());
+      data.resize(static_cast<size_t>(in.gcount()));
+      res.bytes += data.size();
+      send(Chunk{i, std::move(data), false, false});
+    }
+    res.ok = in.eof() && res.error.empty();
+    if (!res.ok && res.error.empty())
+      res.error = "Could not read the file";
+    send(Chunk{i, std::string(), true, false});
+    res.seconds = Secs(Clock::now() - start).count();
+  }
+}
+
+std::vector<FetchResult>
+runUpdatePipeline(const std::vector<UpdateSource> &sources, DB &db,
+                  const PipelineOptions &opts, PipelineStats &stats) {
+  const auto start = Clock::now();
+  const size_t nParsers = std::max<size_t>(opts.parsers, 1);
+  std::vector<FetchResult> results(sources.size());
+  std::vector<size_t> counts(sources.size(), 0); // Written by the parsers.
+  std::vector<char> lost(sources.size(), 0); // URLs whose spill failed.
+  for (size_t i = 0; i < sources.size(); ++i)
+    results[i].url = sources[i].name;
+
+  std::vector<std::unique_ptr<BoundedQueue<Chunk>>> chunks;
+  for (size_t p = 0; p < nParsers; ++p)
+    chunks.emplace_back(new BoundedQueue<Chunk>(kChunksPerParser));
+  BoundedQueue<Batch> batches(kQueuedBatches);
+  auto send = [&](Chunk chunk) {
+    chunks[chunk.source % nParsers]->push(std::move(chunk));
+  };
+
+  // Fetch: download the URLs, and read the files alongside.
+  std::vector<std::string> urls;
+  std::vector<SourceState> previous;
+  std::vector<size_t> urlSources; // Source index of each URL.
+  for (size_t i = 0; i < sources.size(); ++i) {
+    if (sources[i].isFile)
+      continue;
+    urls.push_back(sources[i].name);
+    previous.push_back(sources[i].state);
+    urlSources.push_back(i);
+  }
+  double fetchSeconds = 0.0;
+  std::thread fetcher([&] {
+    const auto fetchStart = Clock::now();
+    std::thread reader([&] { readFiles(sources, results, send); });
+
+    // Downloads arrive in small pieces; gather them up to kChunkBytes.
+    std::vector<std::string> pending(urls.size());
+    auto sink = [&](size_t idx, std::string_view data,
+                    const FetchResult *done) {
+      std::string &buf = pending[idx];
+      buf.append(data.data(), data.size());
+      if (buf.size() >= kChunkBytes || done) {
+        const bool keep =
+            done && done->ok && !done->notModified && !done->unchanged;
+        send(Chunk{urlSources[idx], std::move(buf), done != nullptr, keep});
+        buf.clear();
+      }
+    };
+    auto fetched = fetchURLs(urls, previous, opts.maxConnections, sink);
+    for (size_t i = 0; i < fetched.size(); ++i)
+      results[urlSources[i]] = std::move(fetched[i]);
+    reader.join();
+    fetchSeconds = Secs(Clock::now() - fetchStart).count();
+  });
+
+  // Parse: each thread parses the sources sent to its queue.
+  std::vector<StageStats> parseStats(nParsers);
+  std::vector<std::thread> parsers;
+  for (size_t p = 0; p < nParsers; ++p)
+    parsers.emplace_back([&, p] {
+      std::unordered_map<size_t, std::unique_ptr<ActiveSource>> active;
+      StageStats &st = parseStats[p];
+      Chunk chunk;
+      while (chunks[p]->pop(chunk)) {
+        auto &src = active[chunk.source];
+        if (!src)
+          src.reset(new ActiveSource(sources[chunk.source].name));
+        const auto parseStart = Clock::now();
+        src->parser.feed(chunk.data);
+        if (chunk.last)
+          src->parser.finish();
+        st.seconds += Secs(Clock::now() - parseStart).count();
+        st.bytes += chunk.data.size();
+        const bool isFile = sources[chunk.source].isFile;
+        if (src->batch.size() >= kBatchRecords ||
+            (chunk.last && !src->batch.empty())) {
+          st.items += src->batch.size();
+          if (isFile) {
+            counts[chunk.source] += src->batch.size();
+            batches.push(std::move(src->batch));
+            src->batch.clear();
+          } else {
+            src->hold();
+          }
+        }
+        if (!chunk.last)
+          continue;
+        if (!isFile && chunk.keep &&
+            !src->release([&](Batch records) {
+              counts[chunk.source] += records.size();
+              batches.push(std::move(records));
+            }))
+          lost[chunk.source] = 1;
+        active.erase(chunk.source);
+      }
+    });
+
+  // Close each queue once everything that feeds it is done.
+  std::thread closer([&] {
+    fetcher.join();
+    for (auto &queue : chunks)
+      queue->close();
+    for (auto &parser : parsers)
+      parser.join();
+    batches.close();
+  });
+
+  // Write: gather records into transactions of opts.batchSize.
+  const size_t batchSize = std::max<size_t>(opts.batchSize, 1);
+  StageStats &ws = stats.write;
+  Batch pending, batch;
+
+  // The newest epoch known for each satellite, and whether it came from the
+  // database (rather than from this update).
+  struct Newest {
+    int64_t epoch;
+    bool stored;
+  };
+  std::unordered_map<uint32_t, Newest> newest;
+  const auto loadStart = Clock::now();
+  db.forEachEpoch([&newest](uint32_t norad, int64_t epoch) {
+    newest[norad] = {epoch, true};
+  });
+  ws.seconds += Secs(Clock::now() - loadStart).count();
+  std::unordered_map<uint32_t, size_t> queued; // Index in 'pending'.
+  Batch older; // Superseded element sets, for the history only.
+
+  // In verbose mode each record is printed once its transaction has been
+  // written. updateMany() only reports how many rows it stored, so the
+  // outcome printed is that of the whole transaction; the database reports
+  // which rows failed.
+  size_t refreshed = 0; // Records printed in verbose mode.
+  auto write = [&] {
+    const auto writeStart = Clock::now();
+    const size_t written =
+        db.updateMany(pending.data(), pending.size(), pending.size());
+    ws.seconds += Secs(Clock::now() - writeStart).count();
+    ws.items += written;
+    if (opts.verbose) {
+      const bool ok = written == pending.size();
+      for (const auto &tle : pending) {
+        std::cout << (ok ? "[+] Refreshed [" : "[-] Refreshing [")
+                  << (++refreshed) << ']';
+        if (!ok)
+          std::cout << " (" << pending.size() - written << " of "
+                    << pending.size() << " in its transaction failed)";
+        std::cout << ": " << tle.norad << " (" << tle.name << ')'
+                  << std::endl;
+      }
+    }
+    pending.clear();
+    queued.clear();
+  };
+  auto archive = [&] {
+    const auto writeStart = Clock::now();
+    stats.archived +=
+        db.archiveMany(older.data(), older.size(), older.size());
+    ws.seconds += Secs(Clock::now() - writeStart).count();
+    older.clear();
+  };
+  while (batches.pop(batch)) {
+    for (const auto &tle : batch) {
+      auto known = newest.find(tle.norad);
+      if (known != newest.end() && known->second.epoch >= tle.epoch) {
+        ++(known->second.stored ? stats.current : stats.duplicates);
+        if (known->second.epoch > tle.epoch)
+          older.push_back(tle);
+        continue;
+      }
+      newest[tle.norad] = {tle.epoch, false};
+
+      // Replace an older copy that is still waiting to be written.
+      const auto waiting = queued.find(tle.norad);
+      if (waiting != queued.end()) {
+        older.push_back(pending[waiting->second]);
+        pending[waiting->second] = tle;
+        ++stats.duplicates;
+      } else {
+        queued[tle.norad] = pending.size();
+        pending.push_back(tle);
+      }
+    }
+    if (pending.size() >= batchSize)
+      write();
+    if (older.size() >= batchSize)
+      archive();
+  }
+  if (!pending.empty())
+    write();
+  if (!older.empty())
+    archive();
+  closer.join();
+
+  for (size_t i = 0; i < sources.size(); ++i) {
+    results[i].tles = counts[i];
+    if (lost[i]) {
+      results[i].ok = false;
+      results[i].error = "Could not hold the records until the download ended";
+    }
+    if (results[i].ok) {
+      ++stats.fetch.items;
+      stats.fetch.bytes += results[i].bytes;
+    }
+  }
+  stats.fetch.seconds = fetchSeconds;
+  for (size_t p = 0; p < nParsers; ++p) {
+    stats.fetch.blocked += chunks[p]->fullWaits();
+    stats.parse.starved += chunks[p]->emptyWaits();
+    stats.parse.items += parseStats[p].items;
+    stats.parse.bytes += parseStats[p].bytes;
+    stats.parse.seconds += parseStats[p].seconds;
+  }
+  stats.parse.blocked = batches.fullWaits();
+  ws.starved = batches.emptyWaits();
+  stats.seconds = Secs(Clock::now() - start).count();
+  return results;
+}
@@ -0,0 +1,84 @@
+// satnow: pipeline.hh
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __SATNOW_PIPELINE_HH
+#define __SATNOW_PIPELINE_HH
+#include "db.hh"
+#include "fetch.hh"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// One TLE source to update from.
+struct UpdateSource {
+  std::string name; // URL or file path.
+  bool isFile;
+  // For a URL, what was stored from its last fetch. For a file, its state
+  // now (the caller has already checked that it changed).
+  SourceState state;
+};
+
+// Settings for runUpdatePipeline().
+struct PipelineOptions {
+  size_t parsers = 1;        // Parse threads.
+  size_t maxConnections = 8; // Concurrent downloads.
+  size_t batchSize = DB::kDefaultBatchSize; // Rows per transaction.
+  bool verbose = false;      // Print each record as it is written.
+};
+
+// How much work one stage of the pipeline did.
+struct StageStats {
+  size_t items = 0;     // Sources fetched, TLEs parsed, or TLEs written.
+  size_t bytes = 0;     // Bytes fetched or parsed.
+  double seconds = 0.0; // Time spent working, summed over the threads.
+  size_t blocked = 0;   // Waits for the next stage to make room.
+  size_t starved = 0;   // Waits for the previous stage to send work.
+};
+
+struct PipelineStats {
+  StageStats fetch, parse, write;
+  size_t duplicates = 0; // Copies dropped for a newer one in the update.
+  size_t current = 0;    // TLEs not written as the database was up to date.
+  size_t archived = 0;   // Older TLEs added to the history only.
+  double seconds = 0.0;  // Wall time of the whole update.
+};
+
+// Update 'db' from 'sources' with three stages that run at the same time:
+//   fetch: one thread downloads every URL (see fetchURLs()) while another
+//          reads the files, in pieces.
+//   parse: opts.parsers threads parse the pieces into records. All of a
+//          source's pieces go to the same thread, in order.
+//   write: the calling thread stores the records, opts.batchSize rows per
+//          transaction.
+// The stages are connected by bounded queues, so the memory in use does not
+// grow with the size of the sources. A file's records are written as they
+// are parsed. A URL's records are spilled to a temporary file, and only
+// passed to the writer once its transfer has ended: one that failed (perhaps
+// part way through), was not modified, or has the same content as last time
+// is parsed, but none of its records are written.
+//
+// Sources often overlap, so the writer keeps only the newest epoch of each
+// satellite: a TLE is dropped if the update has already seen one for the
+// same satellite with the same or a newer epoch, or if the database already
+// has one. Which copy is stored therefore doesn't depend on the order of the
+// sources. This costs one entry per satellite in the catalog. A dropped TLE
+// with an older epoch is still added to the history (see DB::archiveMany()).
+// Returns the outcome of each source, in the same order as 'sources'.
+std::vector<FetchResult>
+runUpdatePipeline(const std::vector<UpdateSource> &sources, DB &db,
+                  const PipelineOptions &opts, PipelineStats &stats);
+
+#endif // __SATNOW_PIPELINE_HH
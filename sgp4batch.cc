@@ -0,0 +1,587 @@
+// satnow: sgp4batch.cc
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sgp4batch.hh"
+#include <Globals.h>
+#include <OrbitalElements.h>
+#include <SGP4.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+// Resources:
+// Hoots, Roehrich: Spacetrack Report #3 (SGP4 near-earth model).
+// libsgp4's SGP4::Initialise() and SGP4::FindPositionSGP4(), which this
+// follows term for term so results agree with the scalar path.
+// Moshier: Cephes math library (sin, cos, and atan approximations).
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+// Helpers returning vectors are always inlined into a kernel compiled for the
+// matching instruction set, so the calling convention GCC warns about for the
+// generic (non-AVX) build is never actually used.
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+// Lane types. These use GCC vector extensions so the same kernel source is
+// compiled once per instruction set.
+typedef double V4 __attribute__((vector_size(32)));
+typedef double V8 __attribute__((vector_size(64)));
+
+template <typename V> struct Lanes {
+  static constexpr size_t N = sizeof(V) / sizeof(double);
+};
+
+// Arguments for a kernel invocation over slots [begin, end).
+struct KernelArgs {
+  const std::vector<double> *fields;
+  const int64_t *epochs;
+  size_t count; // Number of satellites (epochs are not padded).
+  int64_t when;
+  std::vector<double> *out;
+  uint8_t *valid;
+  size_t begin, end;
+};
+
+template <typename V> static ALWAYS_INLINE V splat(double d) {
+  V v;
+  for (size_t i = 0; i < Lanes<V>::N; ++i)
+    v[i] = d;
+  return v;
+}
+
+template <typename V> static ALWAYS_INLINE V load(const double *p) {
+  V v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+template <typename V> static ALWAYS_INLINE void store(double *p, const V &v) {
+  std::memcpy(p, &v, sizeof(v));
+}
+
+// Select lanes from 'a' where 'mask' is set, otherwise from 'b'.
+// This is done with bitwise operations rather than a vector ?: since GCC
+// scalarizes the latter for 512-bit vectors.
+template <typename V, typename M>
+static ALWAYS_INLINE V select(const M &mask, const V &a, const V &b) {
+  return (V)(((M)a & mask) | ((M)b & ~mask));
+}
+
+template <typename V> static ALWAYS_INLINE V vabs(const V &x) {
+  return select(x < 0.0, -x, x);
+}
+
+template <typename V> static ALWAYS_INLINE V vsqrt(const V &x) {
+  V r;
+  for (size_t i = 0; i < Lanes<V>::N; ++i)
+    r[i] = __builtin_sqrt(x[i]);
+  return r;
+}
+
+// Round toward negative infinity, valid for |x| < 2^51.
+template <typename V> static ALWAYS_INLINE V vfloor(const V &x) {
+  const double magic = 6755399441055744.0; // 1.5 * 2^52
+  const V r = (x + magic) - magic;         // Round to nearest.
+  return r - select(r > x, splat<V>(1.0), splat<V>(0.0));
+}
+
+// Round toward zero, valid for |x| < 2^51.
+template <typename V> static ALWAYS_INLINE V vtrunc(const V &x) {
+  const V t = vfloor(vabs(x));
+  return select(x < 0.0, -t, t);
+}
+
+// Equivalent of fmod(x, y) for positive y.
+template <typename V> static ALWAYS_INLINE V vfmod(const V &x, double y) {
+  return x - vtrunc(x / y) * y;
+}
+
+// Cephes sin and cos, sharing the argument reduction.
+template <typename V>
+static ALWAYS_INLINE void vsincos(const V &x, V &s, V &c) {
+  const double DP1 = 7.85398125648498535156E-1;
+  const double DP2 = 3.77489470793079817668E-8;
+  const double DP3 = 2.69515142907905952645E-15;
+  const double FOPI = 1.27323954473516268615; // 4/pi
+
+  const V ax = vabs(x);
+  V y = vfloor(ax * FOPI);
+  y = y + (y - 2.0 * vfloor(y * 0.5)); // Make even.
+  const V j = y - 8.0 * vfloor(y * 0.125); // Octant: 0, 2, 4, or 6.
+  const V z = ((ax - y * DP1) - y * DP2) - y * DP3;
+  const V zz = z * z;
+
+  const V ps =
+      z + z * zz *
+              ((((((1.58962301576546568060E-10 * zz) -
+                   2.50507477628578072866E-8) * zz +
+                  2.75573136213857245213E-6) * zz -
+                 1.98412698295895385996E-4) * zz +
+                8.33333333332211858878E-3) * zz -
+               1.66666666666666307295E-1);
+  const V pc =
+      1.0 - 0.5 * zz +
+      zz * zz *
+          ((((((-1.13585365213876817300E-11 * zz) +
+               2.08757008419747316778E-9) * zz -
+              2.75573141792967388112E-7) * zz +
+             2.48015872888517045348E-5) * zz -
+            1.38888888888730564116E-3) * zz +
+           4.16666666666665929218E-2);
+
+  // sin: octant 0 -> ps, 2 -> pc, 4 -> -ps, 6 -> -pc, then odd symmetry.
+  // cos: octant 0 -> pc, 2 -> -ps, 4 -> -pc, 6 -> ps.
+  const auto useCosPoly = (j - 4.0 * vfloor(j * 0.25)) > 1.0; // 2 or 6.
+  const V sv = select(useCosPoly, pc, ps);
+  const V cv = select(useCosPoly, ps, pc);
+  const V sinNeg = select(j > 3.0, -sv, sv);
+  s = select(x < 0.0, -sinNeg, sinNeg);
+  c = select(vabs(j - 3.0) < 2.0, -cv, cv); // 2 or 4.
+}
+
+// Cephes atan2.
+template <typename V> static ALWAYS_INLINE V vatan2(const V &y, const V &x) {
+  const double PIO2 = 1.57079632679489661923;
+  const double PIO4 = 7.85398163397448309616E-1;
+  const double T3P8 = 2.41421356237309504880;
+  const double MOREBITS = 6.123233995736765886130E-17;
+
+  // atan(y / x), reduced to [0, 0.66].
+  const V q = y / x;
+  const V aq = vabs(q);
+  const auto big = aq > T3P8;
+  const auto mid = aq > 0.66; // Overridden by 'big' where both are set.
+  V t = select(mid, (aq - 1.0) / (aq + 1.0), aq);
+  t = select(big, -1.0 / aq, t);
+  const V base = select(big, splat<V>(PIO2),
+                        select(mid, splat<V>(PIO4), splat<V>(0.0)));
+  const V z = t * t;
+  const V p = (((-8.750608600031904122785E-1 * z - 1.615753718733365076637E1) *
+                    z -
+                7.500855792314704667340E1) *
+                   z -
+               1.228866684490136173410E2) *
+                  z -
+              6.485021904942025371773E1;
+  const V qq = ((((z + 2.485846490142306297962E1) * z +
+                  1.650270098316988542046E2) *
+                     z +
+                 4.328810604912902668951E2) *
+                    z +
+                4.853903996359136964868E2) *
+                   z +
+               1.945506571482613964425E2;
+  V r = t * (z * p / qq) + t;
+  r = r + select(big, splat<V>(MOREBITS),
+                 select(mid, splat<V>(0.5 * MOREBITS), splat<V>(0.0)));
+  r = base + r;
+  r = select(q < 0.0, -r, r);
+
+  // Quadrant correction.
+  const V w = select(x < 0.0, select(y < 0.0, splat<V>(-kPI), splat<V>(kPI)),
+                     splat<V>(0.0));
+  return w + r;
+}
+
+template <typename M> static ALWAYS_INLINE bool anySet(const M &mask) {
+  for (size_t i = 0; i < sizeof(M) / sizeof(mask[0]); ++i)
+    if (mask[i])
+      return true;
+  return false;
+}
+
+// Propagate Lanes<V>::N satellites starting at 'slot'.
+template <typename V>
+static ALWAYS_INLINE void propagateLanes(const KernelArgs &args, size_t slot) {
+  const size_t N = Lanes<V>::N;
+#define F(_field) load<V>(&args.fields[_field][slot])
+
+  // Minutes since epoch, computed from integer ticks like TimeSpan does.
+  // Padding lanes reuse the last satellite's epoch.
+  V tsince;
+  for (size_t i = 0; i < N; ++i) {
+    const size_t idx = std::min(slot + i, args.count - 1);
+    tsince[i] = static_cast<double>(args.when - args.epochs[idx]) / 60000000.0;
+  }
+
+  const V xmo = F(SGP4Batch::MeanAnomaly);
+  const V omegao = F(SGP4Batch::ArgPerigee);
+  const V bstar = F(SGP4Batch::BStar);
+  const V aodp = F(SGP4Batch::SemiMajorAxis);
+
+  // Secular gravity and atmospheric drag.
+  const V xmdf = xmo + F(SGP4Batch::Xmdot) * tsince;
+  const V omgadf = omegao + F(SGP4Batch::Omgdot) * tsince;
+  const V xnoddf = F(SGP4Batch::AscendingNode) + F(SGP4Batch::Xnodot) * tsince;
+  const V tsq = tsince * tsince;
+  const V xnode = xnoddf + F(SGP4Batch::Xnodcf) * tsq;
+  V tempa = 1.0 - F(SGP4Batch::C1) * tsince;
+  V tempe = bstar * F(SGP4Batch::C4) * tsince;
+  V templ = F(SGP4Batch::T2cof) * tsq;
+
+  // For the simple model (perigee below 220km) the constants used below are
+  // zero, which reproduces the truncated equations without a branch.
+  V sinxm, cosxm;
+  vsincos(xmdf, sinxm, cosxm);
+  const V delomg = F(SGP4Batch::Omgcof) * tsince;
+  const V eta1 = 1.0 + F(SGP4Batch::Eta) * cosxm;
+  const V delm =
+      F(SGP4Batch::Xmcof) * (eta1 * eta1 * eta1 - F(SGP4Batch::Delmo));
+  const V temp = delomg + delm;
+  const V xmp = xmdf + temp;
+  const V omega = omgadf - temp;
+  const V tcube = tsq * tsince;
+  const V tfour = tsince * tcube;
+  tempa = tempa - F(SGP4Batch::D2) * tsq - F(SGP4Batch::D3) * tcube -
+          F(SGP4Batch::D4) * tfour;
+  V sinxmp, cosxmp;
+  vsincos(xmp, sinxmp, cosxmp);
+  tempe = tempe + bstar * F(SGP4Batch::C5) * (sinxmp - F(SGP4Batch::Sinmo));
+  templ = templ + F(SGP4Batch::T3cof) * tcube +
+          tfour * (F(SGP4Batch::T4cof) + tsince * F(SGP4Batch::T5cof));
+
+  const V a = aodp * tempa * tempa;
+  V e = F(SGP4Batch::Eccentricity) - tempe;
+  const V xl = xmp + omega + xnode + F(SGP4Batch::MeanMotion) * templ;
+  auto bad = e <= -0.001;
+  e = select(e < 1.0e-6, splat<V>(1.0e-6), e);
+  e = select(e > (1.0 - 1.0e-6), splat<V>(1.0 - 1.0e-6), e);
+
+  // Long period periodics.
+  const V beta2 = 1.0 - e * e;
+  const V xn = kXKE / (a * vsqrt(a));
+  V sinom, cosom;
+  vsincos(omega, sinom, cosom);
+  const V axn = e * cosom;
+  const V temp11 = 1.0 / (a * beta2);
+  const V xll = temp11 * F(SGP4Batch::Xlcof) * axn;
+  const V aynl = temp11 * F(SGP4Batch::Aycof);
+  const V xlt = xl + xll;
+  const V ayn = e * sinom + aynl;
+  const V elsq = axn * axn + ayn * ayn;
+  bad = bad | (elsq >= 1.0);
+
+  // Solve Kepler's equation. Lanes stop updating once converged, exactly as
+  // the scalar loop would stop iterating.
+  const V capu = vfmod(xlt - xnode, kTWOPI);
+  const V maxNR = 1.25 * vabs(vsqrt(elsq));
+  V epw = capu, sinepw, cosepw, ecose, esine;
+  auto running = capu == capu;
+  for (int i = 0; i < 10; ++i) {
+    vsincos(epw, sinepw, cosepw);
+    ecose = axn * cosepw + ayn * sinepw;
+    esine = axn * sinepw - ayn * cosepw;
+    const V f = capu - epw + esine;
+    running = running & (vabs(f) >= 1.0e-12);
+    if (!anySet(running))
+      break;
+    const V fdot = 1.0 - ecose;
+    V delta = f / fdot;
+    if (i == 0) {
+      delta = select(delta > maxNR, maxNR, delta);
+      delta = select(delta < -maxNR, -maxNR, delta);
+    } else
+      delta = f / (fdot + 0.5 * esine * delta);
+    epw = epw + select(running, delta, splat<V>(0.0));
+  }
+
+  // Short period preliminary quantities.
+  const V temp21 = 1.0 - elsq;
+  const V pl = a * temp21;
+  bad = bad | (pl < 0.0);
+  const V r = a * (1.0 - ecose);
+  const V temp31 = 1.0 / r;
+  const V rdot = kXKE * vsqrt(a) * esine * temp31;
+  const V rfdot = kXKE * vsqrt(pl) * temp31;
+  const V temp32 = a * temp31;
+  const V betal = vsqrt(temp21);
+  const V temp33 = 1.0 / (1.0 + betal);
+  const V cosu = temp32 * (cosepw - axn + ayn * esine * temp33);
+  const V sinu = temp32 * (sinepw - ayn - axn * esine * temp33);
+  const V u = vatan2(sinu, cosu);
+  const V sin2u = 2.0 * sinu * cosu;
+  const V cos2u = 2.0 * cosu * cosu - 1.0;
+
+  // Short periodics.
+  const V x3thm1 = F(SGP4Batch::X3thm1);
+  const V x1mth2 = F(SGP4Batch::X1mth2);
+  const V cosio = F(SGP4Batch::Cosio);
+  const V temp41 = 1.0 / pl;
+  const V temp42 = kCK2 * temp41;
+  const V temp43 = temp42 * temp41;
+  const V rk = r * (1.0 - 1.5 * temp43 * betal * x3thm1) +
+               0.5 * temp42 * x1mth2 * cos2u;
+  const V uk = u - 0.25 * temp43 * F(SGP4Batch::X7thm1) * sin2u;
+  const V xnodek = xnode + 1.5 * temp43 * cosio * sin2u;
+  const V xinck = F(SGP4Batch::Inclination) +
+                  1.5 * temp43 * cosio * F(SGP4Batch::Sinio) * cos2u;
+  const V rdotk = rdot - xn * temp42 * x1mth2 * sin2u;
+  const V rfdotk = rfdot + xn * temp42 * (x1mth2 * cos2u + 1.5 * x3thm1);
+
+  // Orientation vectors.
+  V sinuk, cosuk, sinik, cosik, sinnok, cosnok;
+  vsincos(uk, sinuk, cosuk);
+  vsincos(xinck, sinik, cosik);
+  vsincos(xnodek, sinnok, cosnok);
+  const V xmx = -sinnok * cosik;
+  const V xmy = cosnok * cosik;
+  const V ux = xmx * sinuk + cosnok * cosuk;
+  const V uy = xmy * sinuk + sinnok * cosuk;
+  const V uz = sinik * sinuk;
+  const V vx = xmx * cosuk - cosnok * sinuk;
+  const V vy = xmy * cosuk - sinnok * sinuk;
+  const V vz = sinik * cosuk;
+  bad = bad | (rk < 1.0);
+
+  // Position (km) and velocity (km/s).
+  const double vscale = kXKMPER / 60.0;
+  store(&args.out[SGP4Batch::X][slot], rk * ux * kXKMPER);
+  store(&args.out[SGP4Batch::Y][slot], rk * uy * kXKMPER);
+  store(&args.out[SGP4Batch::Z][slot], rk * uz * kXKMPER);
+  store(&args.out[SGP4Batch::VX][slot], (rdotk * ux + rfdotk * vx) * vscale);
+  store(&args.out[SGP4Batch::VY][slot], (rdotk * uy + rfdotk * vy) * vscale);
+  store(&args.out[SGP4Batch::VZ][slot], (rdotk * uz + rfdotk * vz) * vscale);
+  for (size_t i = 0; i < N; ++i)
+    args.valid[slot + i] = !bad[i] && slot + i < args.end;
+#undef F
+}
+
+template <typename V> static ALWAYS_INLINE void propagateSlots(KernelArgs &a) {
+  for (size_t slot = a.begin; slot < a.end; slot += Lanes<V>::N)
+    propagateLanes<V>(a, slot);
+}
+
+// One instantiation of the kernel per instruction set.
+static void propagateGeneric(KernelArgs &args) { propagateSlots<V4>(args); }
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_KERNELS 1
+__attribute__((target("avx2"))) static void propagateAVX2(KernelArgs &args) {
+  propagateSlots<V4>(args);
+}
+
+__attribute__((target("avx512f,avx512dq"))) static void
+propagateAVX512(KernelArgs &args) {
+  propagateSlots<V8>(args);
+}
+#endif
+
+bool SGP4Batch::isNearEarth(const Tle &tle) {
+  return OrbitalElements(tle).Period() < 225.0;
+}
+
+bool SGP4Batch::isSupported(Kernel kernel) {
+  switch (kernel) {
+  case Kernel::Generic:
+    return true;
+#if HAVE_X86_KERNELS
+  case Kernel::AVX2:
+    return __builtin_cpu_supports("avx2");
+  case Kernel::AVX512:
+    return __builtin_cpu_supports("avx512f") &&
+           __builtin_cpu_supports("avx512dq");
+#endif
+  default:
+    return false;
+  }
+}
+
+SGP4Batch::Kernel SGP4Batch::bestKernel() {
+  if (isSupported(Kernel::AVX512))
+    return Kernel::AVX512;
+  if (isSupported(Kernel::AVX2))
+    return Kernel::AVX2;
+  return Kernel::Generic;
+}
+
+const char *SGP4Batch::kernelName(Kernel kernel) {
+  switch (kernel) {
+  case Kernel::Generic:
+    return "generic";
+  case Kernel::AVX2:
+    return "avx2";
+  case Kernel::AVX512:
+    return "avx512";
+  }
+  return "unknown";
+}
+
+SGP4Batch::Constants SGP4Batch::constants(const Tle &tle) {
+  const OrbitalElements elements(tle);
+  assert(elements.Period() < 225.0 && "Deep-space satellites can't batch.");
+
+  const double eo = elements.Eccentricity();
+  const double xincl = elements.Inclination();
+  const double aodp = elements.RecoveredSemiMajorAxis();
+  const double xnodp = elements.RecoveredMeanMotion();
+  const double bstar = elements.BStar();
+  const double perigee = elements.Perigee();
+  if (eo < 0.0 || eo > 0.999)
+    throw SatelliteException("Eccentricity out of range");
+  if (xincl < 0.0 || xincl > kPI)
+    throw SatelliteException("Inclination out of range");
+
+  Constants result = {elements.Epoch().Ticks(), {}};
+  double *c = result.fields;
+  c[MeanAnomaly] = elements.MeanAnomoly();
+  c[AscendingNode] = elements.AscendingNode();
+  c[ArgPerigee] = elements.ArgumentPerigee();
+  c[Eccentricity] = eo;
+  c[Inclination] = xincl;
+  c[BStar] = bstar;
+  c[SemiMajorAxis] = aodp;
+  c[MeanMotion] = xnodp;
+
+  // Inclination dependent terms.
+  const double a3ovk2 = -kXJ3 / kCK2 * kAE * kAE * kAE;
+  const double sinio = std::sin(xincl), cosio = std::cos(xincl);
+  const double theta2 = cosio * cosio;
+  c[Sinio] = sinio;
+  c[Cosio] = cosio;
+  c[X3thm1] = 3.0 * theta2 - 1.0;
+  c[X1mth2] = 1.0 - theta2;
+  c[X7thm1] = 7.0 * theta2 - 1.0;
+  c[Xlcof] = 0.125 * a3ovk2 * sinio * (3.0 + 5.0 * cosio) /
+             (std::fabs(cosio + 1.0) > 1.5e-12 ? 1.0 + cosio : 1.5e-12);
+  c[Aycof] = 0.25 * a3ovk2 * sinio;
+
+  const double eosq = eo * eo;
+  const double betao2 = 1.0 - eosq;
+  const double betao = std::sqrt(betao2);
+  const bool simple = perigee < 220.0;
+
+  // For perigee below 156km, s4 and qoms2t are altered.
+  double s4 = kS, qoms24 = kQOMS2T;
+  if (perigee < 156.0) {
+    s4 = perigee - 78.0;
+    if (perigee < 98.0)
+      s4 = 20.0;
+    qoms24 = std::pow((120.0 - s4) * kAE / kXKMPER, 4.0);
+    s4 = s4 / kXKMPER + kAE;
+  }
+
+  const double pinvsq = 1.0 / (aodp * aodp * betao2 * betao2);
+  const double tsi = 1.0 / (aodp - s4);
+  const double eta = aodp * eo * tsi;
+  const double etasq = eta * eta;
+  const double eeta = eo * eta;
+  const double psisq = std::fabs(1.0 - etasq);
+  const double coef = qoms24 * std::pow(tsi, 4.0);
+  const double coef1 = coef / std::pow(psisq, 3.5);
+  const double c2 = coef1 * xnodp *
+                    (aodp * (1.0 + 1.5 * etasq + eeta * (4.0 + etasq)) +
+                     0.75 * kCK2 * tsi / psisq * c[X3thm1] *
+                         (8.0 + 3.0 * etasq * (8.0 + etasq)));
+  const double c1 = bstar * c2;
+  c[Eta] = eta;
+  c[C1] = c1;
+  c[C4] = 2.0 * xnodp * coef1 * aodp * betao2 *
+          (eta * (2.0 + 0.5 * etasq) + eo * (0.5 + 2.0 * etasq) -
+           2.0 * kCK2 * tsi / (aodp * psisq) *
+               (-3.0 * c[X3thm1] *
+                    (1.0 - 2.0 * eeta + etasq * (1.5 - 0.5 * eeta)) +
+                0.75 * c[X1mth2] * (2.0 * etasq - eeta * (1.0 + etasq)) *
+                    std::cos(2.0 * c[ArgPerigee])));
+  const double theta4 = theta2 * theta2;
+  const double temp1 = 3.0 * kCK2 * pinvsq * xnodp;
+  const double temp2 = temp1 * kCK2 * pinvsq;
+  const double temp3 = 1.25 * kCK4 * pinvsq * pinvsq * xnodp;
+  c[Xmdot] = xnodp + 0.5 * temp1 * betao * c[X3thm1] +
+             0.0625 * temp2 * betao * (13.0 - 78.0 * theta2 + 137.0 * theta4);
+  const double x1m5th = 1.0 - 5.0 * theta2;
+  c[Omgdot] = -0.5 * temp1 * x1m5th +
+              0.0625 * temp2 * (7.0 - 114.0 * theta2 + 395.0 * theta4) +
+              temp3 * (3.0 - 36.0 * theta2 + 49.0 * theta4);
+  const double xhdot1 = -temp1 * cosio;
+  c[Xnodot] = xhdot1 + (0.5 * temp2 * (4.0 - 19.0 * theta2) +
+                        2.0 * temp3 * (3.0 - 7.0 * theta2)) *
+                           cosio;
+  c[Xnodcf] = 3.5 * betao2 * xhdot1 * c1;
+  c[T2cof] = 1.5 * c1;
+
+  // Near-earth terms. These stay zero for the simple model.
+  c[Delmo] = std::pow(1.0 + eta * std::cos(c[MeanAnomaly]), 3.0);
+  c[Sinmo] = std::sin(c[MeanAnomaly]);
+  if (!simple) {
+    const double c3 = (eo > 1.0e-4)
+                          ? coef * tsi * a3ovk2 * xnodp * kAE * sinio / eo
+                          : 0.0;
+    c[C5] = 2.0 * coef1 * aodp * betao2 *
+            (1.0 + 2.75 * (etasq + eeta) + eeta * etasq);
+    c[Omgcof] = bstar * c3 * std::cos(c[ArgPerigee]);
+    if (eo > 1.0e-4)
+      c[Xmcof] = -kTWOTHIRD * coef * bstar * kAE / eeta;
+    const double c1sq = c1 * c1;
+    c[D2] = 4.0 * aodp * tsi * c1sq;
+    const double temp = c[D2] * tsi * c1 / 3.0;
+    c[D3] = (17.0 * aodp + s4) * temp;
+    c[D4] = 0.5 * temp * aodp * tsi * (221.0 * aodp + 31.0 * s4) * c1;
+    c[T3cof] = c[D2] + 2.0 * c1sq;
+    c[T4cof] = 0.25 * (3.0 * c[D3] + c1 * (12.0 * c[D2] + 10.0 * c1sq));
+    c[T5cof] = 0.2 * (3.0 * c[D4] + 12.0 * c1 * c[D3] + 6.0 * c[D2] * c[D2] +
+                      15.0 * c1sq * (2.0 * c[D2] + c1sq));
+  }
+  return result;
+}
+
+size_t SGP4Batch::add(const Constants &constants) {
+  const double *c = constants.fields;
+
+  // Grow by a whole block at a time, padding the new block with copies of
+  // this satellite so that padded lanes compute something well behaved.
+  const size_t slot = size();
+  if (slot % kBlock == 0) {
+    for (size_t f = 0; f < NumFields; ++f)
+      _fields[f].resize(slot + kBlock, c[f]);
+    for (auto &out : _out)
+      out.resize(slot + kBlock, 0.0);
+    _valid.resize(slot + kBlock, 0);
+  }
+  for (size_t f = 0; f < NumFields; ++f)
+    _fields[f][slot] = c[f];
+  _epochs.push_back(constants.epoch);
+  return slot;
+}
+
+void SGP4Batch::propagate(const DateTime &when, size_t beginBlock,
+                          size_t endBlock) {
+  assert(beginBlock <= endBlock && endBlock <= blocks() && "Invalid blocks.");
+  if (beginBlock == endBlock)
+    return;
+
+  KernelArgs args = {_fields,
+                     _epochs.data(),
+                     size(),
+                     when.Ticks(),
+                     _out,
+                     _valid.data(),
+                     beginBlock * kBlock,
+                     std::min(size(), endBlock * kBlock)};
+  switch (_kernel) {
+#if HAVE_X86_KERNELS
+  case Kernel::AVX512:
+    propagateAVX512(args);
+    break;
+  case Kernel::AVX2:
+    propagateAVX2(args);
+    break;
+#endif
+  default:
+    propagateGeneric(args);
+    break;
+  }
+}
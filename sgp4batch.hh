@@ -0,0 +1,117 @@
+// satnow: sgp4batch.hh
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __SATNOW_SGP4BATCH_HH
+#define __SATNOW_SGP4BATCH_HH
+#include <DateTime.h>
+#include <Tle.h>
+#include <Vector.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Batch propagator for near-earth (SGP4, period < 225 minutes) satellites.
+//
+// This mirrors libsgp4's near-earth model, but the per-satellite constants are
+// kept as structure-of-arrays and the propagation is branch free, so a single
+// instruction stream advances 4 (AVX2) or 8 (AVX-512) satellites at once.
+// The kernel is chosen at runtime from what the CPU supports. Deep-space
+// (SDP4) satellites are not handled here and must use libsgp4's SGP4 class.
+//
+// Satellites are stored in slots, which are grouped into blocks of kBlock.
+// Propagation works on whole blocks so that kernels never need a remainder
+// loop; unused slots in the last block are padding and are never valid.
+class SGP4Batch {
+public:
+  enum class Kernel { Generic, AVX2, AVX512 };
+  static constexpr size_t kBlock = 8; // Multiple of every kernel's lane count.
+
+  // Return true if 'tle' uses the near-earth model and can be batched.
+  static bool isNearEarth(const Tle &tle);
+
+  // The fastest kernel supported by this CPU. Generic is the portable
+  // baseline build of the kernel, and is what callers should treat as "no
+  // SIMD available".
+  static Kernel bestKernel();
+  static bool isSupported(Kernel kernel);
+  static const char *kernelName(Kernel kernel);
+
+  explicit SGP4Batch(Kernel kernel = bestKernel()) : _kernel(kernel) {}
+
+  size_t size() const { return _epochs.size(); }
+  size_t blocks() const { return (size() + kBlock - 1) / kBlock; }
+  Kernel kernel() const { return _kernel; }
+  void setKernel(Kernel kernel) { _kernel = kernel; }
+
+  // Propagate the satellites in blocks [beginBlock, endBlock) to 'when'.
+  // Disjoint block ranges can be propagated concurrently.
+  void propagate(const DateTime &when, size_t beginBlock, size_t endBlock);
+
+  // Results of the last propagate() call for 'slot'. Position is in km and
+  // velocity in km/s, both in ECI. A slot is not valid if libsgp4 would have
+  // thrown for it (e.g., the satellite has decayed), in which case the caller
+  // should fall back to libsgp4 to get the same error.
+  bool valid(size_t slot) const { return _valid[slot]; }
+  Vector position(size_t slot) const {
+    return Vector(_out[X][slot], _out[Y][slot], _out[Z][slot]);
+  }
+  Vector velocity(size_t slot) const {
+    return Vector(_out[VX][slot], _out[VY][slot], _out[VZ][slot]);
+  }
+
+  // Per-satellite constants, one array per field.
+  enum Field {
+    // Mean elements at epoch.
+    MeanAnomaly, AscendingNode, ArgPerigee, Eccentricity, Inclination, BStar,
+    SemiMajorAxis, MeanMotion,
+    // Secular and drag terms.
+    Xmdot, Omgdot, Xnodot, Xnodcf, C1, C4, C5, Eta, T2cof, T3cof, T4cof,
+    T5cof, D2, D3, D4, Omgcof, Xmcof, Delmo, Sinmo,
+    // Inclination dependent terms.
+    Sinio, Cosio, X3thm1, X1mth2, X7thm1, Xlcof, Aycof,
+    NumFields
+  };
+
+  // Propagation output, one array per component.
+  enum Output { X, Y, Z, VX, VY, VZ, NumOutputs };
+
+  // Everything add() needs to know about a satellite. This depends only on
+  // the TLE, so it can be computed once and stored (see CatalogSnapshot).
+  struct Constants {
+    int64_t epoch; // DateTime ticks.
+    double fields[NumFields];
+  };
+
+  // Compute the constants of a near-earth satellite.
+  // Throws, as libsgp4 does, if the elements are out of range.
+  static Constants constants(const Tle &tle);
+
+  // Add a near-earth satellite and return its slot.
+  size_t add(const Constants &c);
+  size_t add(const Tle &tle) { return add(constants(tle)); }
+
+  // Raw results of the last propagate() call, indexed by slot.
+  const double *output(Output o) const { return _out[o].data(); }
+
+private:
+  Kernel _kernel;
+  std::vector<int64_t> _epochs; // DateTime ticks of each satellite's epoch.
+  std::vector<double> _fields[NumFields];
+  std::vector<double> _out[NumOutputs];
+  std::vector<uint8_t> _valid;
+};
+
+#endif // __SATNOW_SGP4BATCH_HH
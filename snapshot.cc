@@ -0,0 +1,84 @@
+// satnow: snapshot.cc
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "snapshot.hh"
+#include <SGP4.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+static const char kMagic[8] = {'S', 'A', 'T', 'N', 'O', 'W', 'S', 'N'};
+
+CatalogSnapshot::CatalogSnapshot(const std::string &path)
+    : _file(path), _header(nullptr), _records(nullptr) {
+  const auto data = _file.view();
+  if (!_file.ok() || data.size() < sizeof(Header))
+    return;
+  const auto *header = reinterpret_cast<const Header *>(data.data());
+  if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) ||
+      header->version != kVersion ||
+      header->recordSize != sizeof(SnapshotRecord) ||
+      header->count > (data.size() - sizeof(Header)) / sizeof(SnapshotRecord))
+    return;
+  _header = header;
+  _records = reinterpret_cast<const SnapshotRecord *>(data.data() +
+                                                      sizeof(Header));
+}
+
+// The snapshot is written to a temporary file that replaces 'path' once it is
+// complete, so a reader never maps a partly written snapshot.
+long CatalogSnapshot::write(DB &db, const std::string &path) {
+  const std::string tmpPath = path + ".tmp";
+  std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+  if (!out)
+    return -1;
+
+  Header header = {};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.recordSize = sizeof(SnapshotRecord);
+  header.generation = db.generation();
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  db.forEachTLE([&](const TleRecord &tle) {
+    SnapshotRecord rec = {};
+    rec.tle = tle;
+    const Tle full = tle.toTle();
+    rec.bounds = HorizonFilter::bounds(full);
+    if (SGP4Batch::isNearEarth(full)) {
+      try {
+        rec.constants = SGP4Batch::constants(full);
+        rec.nearEarth = 1;
+      } catch (const SatelliteException &) {
+        // Leave it to libsgp4, which will report the error when used.
+      }
+    }
+    out.write(reinterpret_cast<const char *>(&rec), sizeof(rec));
+    ++header.count;
+  });
+
+  // Fill in the count now that it is known.
+  out.seekp(0);
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.close();
+  if (!out || std::rename(tmpPath.c_str(), path.c_str())) {
+    std::remove(tmpPath.c_str());
+    return -1;
+  }
+  return static_cast<long>(header.count);
+}
+
+std::string snapshotPath(const std::string &dbFile) { return dbFile + ".snap"; }
@@ -0,0 +1,83 @@
+// satnow: snapshot.hh
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __SATNOW_SNAPSHOT_HH
+#define __SATNOW_SNAPSHOT_HH
+#include "db.hh"
+#include "horizon.hh"
+#include "sgp4batch.hh"
+#include "tleparser.hh"
+#include "tlerecord.hh"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+// One satellite in a snapshot: its TLE, already parsed, and everything that
+// SatLookAngles would otherwise derive from it on startup.
+struct SnapshotRecord {
+  TleRecord tle;
+  HorizonFilter::Bounds bounds;
+  SGP4Batch::Constants constants; // Only valid if 'nearEarth' is set.
+  uint8_t nearEarth;              // Can be propagated by SGP4Batch.
+};
+
+static_assert(std::is_trivially_copyable<SnapshotRecord>::value,
+              "SnapshotRecord must be trivially copyable.");
+
+// A read-only, memory mapped copy of the catalog in the database.
+//
+// The file is a header followed by an array of fixed-size SnapshotRecords,
+// so it is used in place: nothing is parsed or copied to load it. The header
+// records the DB::generation() that the snapshot was taken at; a snapshot
+// whose generation no longer matches the database is stale and must not be
+// used. The header also holds a format version and the record size, and a
+// snapshot written by a different build is treated as missing.
+class CatalogSnapshot {
+public:
+  static constexpr uint32_t kVersion = 1;
+
+  struct Header {
+    char magic[8]; // "SATNOWSN"
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t generation;
+    uint64_t count;
+  };
+
+private:
+  MappedFile _file;
+  const Header *_header;
+  const SnapshotRecord *_records;
+
+public:
+  explicit CatalogSnapshot(const std::string &path);
+
+  // The snapshot exists and was written by this version of satnow.
+  bool ok() const { return _header != nullptr; }
+  uint64_t generation() const { return _header->generation; }
+  size_t size() const { return ok() ? _header->count : 0; }
+  const SnapshotRecord &operator[](size_t idx) const { return _records[idx]; }
+
+  // Write every TLE in 'db' to a snapshot at 'path', replacing any that is
+  // there. Returns the number of records written, or -1 on error.
+  static long write(DB &db, const std::string &path);
+};
+
+// The snapshot kept next to the database at 'dbFile'.
+std::string snapshotPath(const std::string &dbFile);
+
+#endif // __SATNOW_SNAPSHOT_HH
@@ -0,0 +1,79 @@
+// satnow: sweep.cc
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "sweep.hh"
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+size_t sweepLookAngles(
+    const std::vector<TleRecord> &tles, double lat, double lon, double alt,
+    const LookAngleOptions &opts, const TimeGrid &grid, size_t workers,
+    const std::function<void(size_t step, SatLookAngles &sats)> &emit) {
+  const size_t steps = grid.steps();
+  workers = std::max<size_t>(std::min(workers, steps), 1);
+  if (steps == 0)
+    return 0;
+
+  std::mutex lock;
+  std::condition_variable changed;
+  size_t next = 0; // The next step to emit (only the caller changes it).
+  // Each worker's SatLookAngles from when it finishes a step until the step
+  // is emitted, and nullptr while it is working.
+  std::vector<SatLookAngles *> done(workers, nullptr);
+
+  std::vector<std::thread> threads;
+  for (size_t w = 0; w < workers; ++w)
+    threads.emplace_back([&, w] {
+      LookAngleOptions workerOpts = opts;
+      workerOpts.nThreads = 1;
+      workerOpts.time = grid.at(w).Ticks();
+      SatLookAngles sats(lat, lon, alt, workerOpts);
+      for (const auto &tle : tles)
+        sats.add(tle);
+
+      for (size_t step = w; step < steps; step += workers) {
+        sats.updatePositions(grid.at(step));
+        sats.sort();
+        std::unique_lock<std::mutex> lk(lock);
+        done[w] = &sats;
+        changed.notify_all();
+        changed.wait(lk, [&] { return next > step; });
+      }
+    });
+
+  while (next < steps) {
+    const size_t w = next % workers;
+    SatLookAngles *sats;
+    {
+      std::unique_lock<std::mutex> lk(lock);
+      changed.wait(lk, [&] { return done[w] != nullptr; });
+      sats = done[w];
+    }
+    // The worker waits for this step to be emitted before touching 'sats'.
+    emit(next, *sats);
+    std::lock_guard<std::mutex> lk(lock);
+    done[w] = nullptr;
+    ++next;
+    changed.notify_all();
+  }
+  for (auto &thread : threads)
+    thread.join();
+  return steps;
+}
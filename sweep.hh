@@ -0,0 +1,65 @@
+// satnow: sweep.hh
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef __SATNOW_SWEEP_HH
+#define __SATNOW_SWEEP_HH
+#include "main.hh"
+#include "tlerecord.hh"
+#include <DateTime.h>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Evenly spaced times: start, start + step, ..., up to and including end.
+// The step is rounded to whole ticks (microseconds) so that no time drifts.
+struct TimeGrid {
+  DateTime start, end;
+  double stepSecs = 60.0;
+
+  int64_t stepTicks() const {
+    return static_cast<int64_t>(std::llround(stepSecs * 1e6));
+  }
+  size_t steps() const {
+    if (end.Ticks() < start.Ticks() || stepTicks() <= 0)
+      return 0;
+    return static_cast<size_t>((end.Ticks() - start.Ticks()) / stepTicks()) +
+           1;
+  }
+  DateTime at(size_t step) const {
+    return DateTime(start.Ticks() + static_cast<int64_t>(step) * stepTicks());
+  }
+};
+
+// Calculate the look angles of 'tles' from lat/lon/alt at every time of
+// 'grid', and call 'emit' with each step's (sorted) look angles, in time
+// order, on the calling thread.
+//
+// The steps are dealt out to 'workers' threads, step i to worker
+// i % workers, and each worker has its own SatLookAngles (built from
+// 'opts', single threaded). A worker only starts its next step once its last
+// one has been emitted, so the steps complete in about the order they are
+// emitted, and at most 'workers' are held in memory. Each worker keeps a copy
+// of the catalog's models.
+// Returns the number of steps emitted.
+size_t sweepLookAngles(
+    const std::vector<TleRecord> &tles, double lat, double lon, double alt,
+    const LookAngleOptions &opts, const TimeGrid &grid, size_t workers,
+    const std::function<void(size_t step, SatLookAngles &sats)> &emit);
+
+#endif // __SATNOW_SWEEP_HH
@@ -0,0 +1,129 @@
+// satnow: tests/fetch_check.cc
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Checks fetchURLs() and TleStreamParser together, the way --update uses
+// them, on file:// URLs so that no server is needed. The records parsed from
+// the pieces handed to the sink must match parsing the file in one piece,
+// every transfer must end with exactly one call with its result, and a
+// second fetch of the same content must be reported as unchanged. Exits
+// non-zero on any difference.
+
+#include "../fetch.hh"
+#include "../tleparser.hh"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static const size_t kRecords = 5000;
+
+static bool check(bool ok, const std::string &what) {
+  std::cout << (ok ? "[+] " : "[-] ") << what << std::endl;
+  return ok;
+}
+
+// What the sink saw of one transfer.
+struct Received {
+  std::vector<TleRecord> tles;
+  std::unique_ptr<TleStreamParser> parser;
+  size_t pieces = 0;
+  size_t results = 0;    // Calls with a result; must be exactly one.
+  bool lateData = false; // Data after the result.
+};
+
+static std::vector<FetchResult> fetch(const std::vector<std::string> &urls,
+                                      const std::vector<SourceState> &previous,
+                                      std::vector<Received> &received) {
+  received = std::vector<Received>(urls.size());
+  for (size_t i = 0; i < urls.size(); ++i)
+    received[i].parser.reset(new TleStreamParser(urls[i], received[i].tles));
+  return fetchURLs(urls, previous, 2,
+                   [&](size_t idx, std::string_view data,
+                       const FetchResult *done) {
+                     Received &r = received[idx];
+                     r.lateData = r.lateData || (r.results && !data.empty());
+                     if (!data.empty()) {
+                       ++r.pieces;
+                       r.parser->feed(data);
+                     }
+                     if (done) {
+                       ++r.results;
+                       r.parser->finish();
+                     }
+                   });
+}
+
+int main() {
+  std::string text;
+  for (size_t i = 0; i < kRecords; ++i) {
+    const std::string id = std::to_string(10000 + i);
+    text += "SAT " + id + "\n1 " + id +
+            "U 98067A   19100.50000000  .00001264  00000-0  27213-4 0  9998\n"
+            "2 " + id +
+            "  51.6433 344.1334 0002165 157.3264 324.7425 15.52530358164665\n";
+  }
+  char path[] = "/tmp/satnow_fetch_check_XXXXXX";
+  const int fd = mkstemp(path);
+  if (fd < 0 || write(fd, text.data(), text.size()) !=
+                    static_cast<ssize_t>(text.size())) {
+    std::cerr << "[-] Could not write " << path << std::endl;
+    return EXIT_FAILURE;
+  }
+  close(fd);
+
+  std::vector<TleRecord> whole;
+  parseTLEs(text, "whole", whole);
+  const std::vector<std::string> urls = {std::string("file://") + path,
+                                         std::string("file://") + path +
+                                             ".missing"};
+  std::vector<Received> received;
+  auto results = fetch(urls, std::vector<SourceState>(urls.size()), received);
+
+  bool passed = check(results[0].ok && !results[0].unchanged &&
+                          results[0].state.hash == hashContent(text),
+                      "Fetched " + std::to_string(results[0].bytes) +
+                          " bytes in " +
+                          std::to_string(received[0].pieces) + " pieces");
+  bool same = received[0].tles.size() == whole.size();
+  for (size_t i = 0; same && i < whole.size(); ++i)
+    same = !strcmp(received[0].tles[i].line1, whole[i].line1) &&
+           !strcmp(received[0].tles[i].line2, whole[i].line2) &&
+           !strcmp(received[0].tles[i].name, whole[i].name);
+  passed = check(same, "Streamed " + std::to_string(received[0].tles.size()) +
+                           " records, " + std::to_string(whole.size()) +
+                           " in one piece") &&
+           passed;
+  passed = check(!results[1].ok && received[1].tles.empty(),
+                 "Missing file failed: " + results[1].error) &&
+           passed;
+  for (const auto &r : received)
+    passed = check(r.results == 1 && !r.lateData,
+                   "One result per transfer, after its data") &&
+             passed;
+
+  // The same content again.
+  results = fetch({urls[0]}, {results[0].state}, received);
+  passed = check(results[0].ok && results[0].unchanged,
+                 "Second fetch reported as unchanged") &&
+           passed;
+
+  unlink(path);
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,132 @@
+// satnow: tests/sgp4batch_check.cc
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Checks each SGP4Batch kernel that this CPU supports against libsgp4 on a
+// fixed set of near-earth TLEs, over two days around their epoch. Exits
+// non-zero if a kernel's position differs from libsgp4's by more than
+// kMaxErrorKm, or if it disagrees with libsgp4 about which satellites can be
+// propagated (e.g., have decayed).
+
+#include "../sgp4batch.hh"
+#include <SGP4.h>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// The kernels follow libsgp4 term for term, so any difference is rounding.
+static const double kMaxErrorKm = 1e-3;
+
+// Both drag models (perigee above and below 220 km, and below 156 km),
+// high eccentricity, polar, retrograde, near-equatorial and long period
+// orbits, and negative drag. Ten satellites fill one block and part of the
+// next, so padding is exercised too.
+static const char *const kTLEs[][3] = {
+    {"ISS (ZARYA)",
+     "1 25544U 98067A   19100.50000000  .00001264  00000-0  27213-4 0  9998",
+     "2 25544  51.6433 344.1334 0002165 157.3264 324.7425 15.52530358164665"},
+    {"SUN-SYNCHRONOUS",
+     "1 90001U 98067A   19100.50000000  .00000123  00000-0  12345-4 0  9991",
+     "2 90001  98.2123  12.3456 0011234  90.1234 270.0123 14.57123456164664"},
+    {"ECCENTRIC",
+     "1 90002U 98067A   19100.50000000  .00000023  00000-0  28098-4 0  9993",
+     "2 90002  34.2682 348.7242 1859667 331.7664  19.3264 10.82419157164666"},
+    {"LOW PERIGEE",
+     "1 90003U 98067A   19100.50000000  .00073094  00000-0  66816-4 0  9992",
+     "2 90003  72.8435 115.9689 0086731  52.6988 110.5714 16.05824518164667"},
+    {"VERY LOW PERIGEE",
+     "1 90009U 98067A   19100.50000000  .00123456  00000-0  98765-4 0  9994",
+     "2 90009  51.6000  10.0000 0100000  80.0000 280.0000 16.30000000164665"},
+    {"RETROGRADE",
+     "1 90004U 98067A   19100.50000000  .00000456  00000-0  23456-4 0  9998",
+     "2 90004 143.0012 200.1234 0012345 123.4567 236.7890 15.01234567164663"},
+    {"POLAR",
+     "1 90005U 98067A   19100.50000000  .00000078  00000-0  34567-5 0  9995",
+     "2 90005  90.0001  45.6789 0102345 300.1234  59.8765 14.01234567164669"},
+    {"LOW INCLINATION",
+     "1 90006U 98067A   19100.50000000  .00000345  00000-0  45678-4 0  9997",
+     "2 90006   1.0123 150.0000 0005678  10.0000 350.0000 15.21234567164664"},
+    {"LONG PERIOD",
+     "1 90007U 98067A   19100.50000000  .00000012  00000-0  10000-4 0  9990",
+     "2 90007  63.4012 270.5432 0501234 270.1234  89.8765  6.50123456164669"},
+    {"NEGATIVE DRAG",
+     "1 90008U 98067A   19100.50000000 -.00000234  00000-0 -12345-4 0  9993",
+     "2 90008  28.4567  99.9999 0003456  45.6789 314.3210 15.91234567164662"},
+};
+
+int main() {
+  std::vector<SGP4> models;
+  SGP4Batch batch;
+  for (const auto &lines : kTLEs) {
+    const Tle tle(lines[0], lines[1], lines[2]);
+    if (!SGP4Batch::isNearEarth(tle)) {
+      std::cerr << "[-] Not a near-earth TLE: " << lines[0] << std::endl;
+      return EXIT_FAILURE;
+    }
+    models.emplace_back(tle);
+    batch.add(tle);
+  }
+
+  // Every 20 minutes from a day before the epoch to a day after it.
+  const DateTime epoch = Tle(kTLEs[0][0], kTLEs[0][1], kTLEs[0][2]).Epoch();
+  std::vector<DateTime> times;
+  for (int minutes = -1440; minutes <= 1440; minutes += 20)
+    times.push_back(epoch.AddMinutes(minutes));
+
+  // Reference positions from libsgp4.
+  std::vector<std::vector<Vector>> expected(times.size());
+  std::vector<std::vector<bool>> ok(times.size());
+  for (size_t t = 0; t < times.size(); ++t)
+    for (const auto &model : models) {
+      try {
+        expected[t].push_back(model.FindPosition(times[t]).Position());
+        ok[t].push_back(true);
+      } catch (...) {
+        expected[t].push_back(Vector());
+        ok[t].push_back(false);
+      }
+    }
+
+  bool passed = true;
+  for (const auto kernel : {SGP4Batch::Kernel::Generic, SGP4Batch::Kernel::AVX2,
+                            SGP4Batch::Kernel::AVX512}) {
+    if (!SGP4Batch::isSupported(kernel)) {
+      std::cout << "[+] " << SGP4Batch::kernelName(kernel)
+                << ": not supported here, skipped" << std::endl;
+      continue;
+    }
+    batch.setKernel(kernel);
+    double maxErr = 0.0;
+    size_t mismatches = 0;
+    for (size_t t = 0; t < times.size(); ++t) {
+      batch.propagate(times[t], 0, batch.blocks());
+      for (size_t i = 0; i < batch.size(); ++i) {
+        if (ok[t][i] != batch.valid(i))
+          ++mismatches;
+        else if (ok[t][i])
+          maxErr = std::max(
+              maxErr, (batch.position(i) - expected[t][i]).Magnitude());
+      }
+    }
+    const bool good = mismatches == 0 && maxErr <= kMaxErrorKm;
+    passed = passed && good;
+    std::cout << (good ? "[+] " : "[-] ") << SGP4Batch::kernelName(kernel)
+              << ": max position error " << maxErr << " km (limit "
+              << kMaxErrorKm << "), " << mismatches
+              << " disagreements on validity" << std::endl;
+  }
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
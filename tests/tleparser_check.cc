@@ -0,0 +1,108 @@
+// satnow: tests/tleparser_check.cc
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Checks that parseTLEs() gives the same records whether it runs on one
+// thread or several, and that TleStreamParser gives the same records again
+// when the text arrives in pieces of any size. The text mixes named and
+// unnamed records, CRLF line ends, blank lines and a few broken records, and
+// is large enough to be split for parallel parsing. Exits non-zero on any
+// difference.
+
+#include "../threadpool.hh"
+#include "../tleparser.hh"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static const size_t kRecords = 10000;
+
+// A record for satellite 'norad', laid out as variant 'i' picks.
+// Returns false if the record is deliberately broken.
+static bool addRecord(std::string &text, size_t i, unsigned norad) {
+  std::string line1 = "1 25544U 98067A   19100.50000000  .00001264  00000-0  "
+                      "27213-4 0  9998";
+  std::string line2 = "2 25544  51.6433 344.1334 0002165 157.3264 324.7425 "
+                      "15.52530358164665";
+  const std::string id = std::to_string(10000 + norad % 90000);
+  line1.replace(2, 5, id);
+  line2.replace(2, 5, id);
+  switch (i % 8) {
+  case 0:
+    text += line1 + '\n' + line2 + '\n';
+    return true;
+  case 1:
+    text += "SAT " + id + "\r\n" + line1 + "\r\n" + line2 + "\r\n";
+    return true;
+  case 2:
+    text += "\nA NAME LONGER THAN TWENTY TWO BYTES " + id + '\n' + line1 +
+            '\n' + line2 + '\n';
+    return true;
+  case 3:
+    if (i % 1000 == 3) {
+      text += line1 + '\n' + line2.substr(0, 30) + '\n';
+      return false;
+    }
+    // Fall through.
+  default:
+    text += "SAT " + id + '\n' + line1 + '\n' + line2 + '\n';
+    return true;
+  }
+}
+
+static bool same(const std::vector<TleRecord> &a,
+                 const std::vector<TleRecord> &b, const char *what) {
+  bool ok = a.size() == b.size();
+  for (size_t i = 0; ok && i < a.size(); ++i)
+    ok = !strcmp(a[i].name, b[i].name) && !strcmp(a[i].line1, b[i].line1) &&
+         !strcmp(a[i].line2, b[i].line2) && a[i].norad == b[i].norad &&
+         a[i].epoch == b[i].epoch;
+  std::cout << (ok ? "[+] " : "[-] ") << what << ": " << b.size()
+            << " records" << (ok ? "" : ", which differ from one thread")
+            << std::endl;
+  return ok;
+}
+
+int main() {
+  std::string text;
+  size_t valid = 0;
+  for (size_t i = 0; i < kRecords; ++i)
+    valid += addRecord(text, i, static_cast<unsigned>(i));
+  text += "TAIL WITHOUT ITS DATA LINES";
+
+  std::vector<TleRecord> serial;
+  parseTLEs(text, "serial", serial);
+  bool passed = serial.size() == valid;
+  std::cout << (passed ? "[+] " : "[-] ") << "One thread: " << serial.size()
+            << " records (expected " << valid << ')' << std::endl;
+
+  ThreadPool pool(4);
+  std::vector<TleRecord> parallel;
+  parseTLEs(text, "parallel", parallel, pool);
+  passed = same(serial, parallel, "Four threads") && passed;
+
+  // Pieces of 1 to 4099 bytes, so lines are split at every position.
+  std::vector<TleRecord> streamed;
+  TleStreamParser parser("streamed", streamed);
+  for (size_t at = 0, size = 1; at < text.size(); at += size, size += 7) {
+    size = size > 4099 ? 1 : size;
+    parser.feed(std::string_view(text).substr(at, size));
+  }
+  parser.finish();
+  passed = same(serial, streamed, "Streamed") && passed;
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,95 @@
+// satnow: threadpool.cc
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "threadpool.hh"
+
+ThreadPool::ThreadPool(size_t nThreads)
+    : _job(nullptr), _count(0), _generation(0), _remaining(0), _stop(false) {
+  // Worker ids start at 1, chunk 0 belongs to the calling thread.
+  for (size_t i = 1; i < nThreads; ++i)
+    _workers.emplace_back(&ThreadPool::worker, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lk(_lock);
+    _stop = true;
+  }
+  _wake.notify_all();
+  for (auto &thr : _workers)
+    thr.join();
+}
+
+// Run the current job on [begin, end), keeping the first exception it throws
+// for parallelFor() to rethrow.
+void ThreadPool::run(size_t begin, size_t end) {
+  try {
+    (*_job)(begin, end);
+  } catch (...) {
+    std::lock_guard<std::mutex> lk(_lock);
+    if (!_error)
+      _error = std::current_exception();
+  }
+}
+
+void ThreadPool::worker(size_t id) {
+  size_t seen = 0;
+  std::unique_lock<std::mutex> lk(_lock);
+  for (;;) {
+    _wake.wait(lk, [&] { return _stop || _generation != seen; });
+    if (_stop)
+      return;
+    seen = _generation;
+    const size_t n = _count, nThreads = size();
+    lk.unlock();
+
+    run(n * id / nThreads, n * (id + 1) / nThreads);
+
+    lk.lock();
+    if (--_remaining == 0)
+      _done.notify_one();
+  }
+}
+
+void ThreadPool::parallelFor(size_t n, const RangeFn &fn) {
+  if (_workers.empty()) {
+    fn(0, n);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lk(_lock);
+    _job = &fn;
+    _count = n;
+    _remaining = _workers.size();
+    _error = nullptr;
+    ++_generation;
+  }
+  _wake.notify_all();
+
+  // The calling thread takes the first chunk.
+  run(0, n / size());
+
+  std::unique_lock<std::mutex> lk(_lock);
+  _done.wait(lk, [this] { return _remaining == 0; });
+  _job = nullptr;
+  if (_error) {
+    const std::exception_ptr error = _error;
+    _error = nullptr;
+    lk.unlock();
+    std::rethrow_exception(error);
+  }
+}
@@ -0,0 +1,65 @@
+// satnow: threadpool.hh
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __SATNOW_THREADPOOL_HH
+#define __SATNOW_THREADPOOL_HH
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that live as long as the pool.
+// Work is handed out as contiguous index ranges, one range per thread, and
+// the calling thread always processes the first range itself.
+class ThreadPool {
+public:
+  using RangeFn = std::function<void(size_t begin, size_t end)>;
+
+private:
+  std::vector<std::thread> _workers;
+  std::mutex _lock;
+  std::condition_variable _wake; // Signals workers that a job is ready.
+  std::condition_variable _done; // Signals the caller that workers finished.
+  const RangeFn *_job;           // Current job (owned by parallelFor caller).
+  size_t _count;                 // Number of items in the current job.
+  size_t _generation;            // Incremented for each new job.
+  size_t _remaining;             // Workers still running the current job.
+  std::exception_ptr _error;     // First exception thrown by the job.
+  bool _stop;
+  void worker(size_t id);
+  void run(size_t begin, size_t end);
+
+public:
+  // 'nThreads' includes the calling thread, so 1 means run serially.
+  explicit ThreadPool(size_t nThreads);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // Total number of threads (workers plus the caller).
+  size_t size() const { return _workers.size() + 1; }
+
+  // Split [0, n) into size() contiguous chunks and run fn(begin, end) on each
+  // chunk concurrently. Returns once every chunk has been processed. If any
+  // chunk throws, the first exception is rethrown here once all of them have
+  // finished.
+  void parallelFor(size_t n, const RangeFn &fn);
+};
+
+#endif // __SATNOW_THREADPOOL_HH
@@ -0,0 +1,226 @@
+// satnow: tleparser.cc
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tleparser.hh"
+#include <algorithm>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string &path)
+    : _data(nullptr), _size(0), _ok(false) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+  map(fd);
+  close(fd); // The mapping stays valid.
+}
+
+void MappedFile::map(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) || !S_ISREG(st.st_mode))
+    return;
+  _size = static_cast<size_t>(st.st_size);
+  if (_size == 0) {
+    _ok = true; // Nothing to map.
+    return;
+  }
+  _data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (_data == MAP_FAILED) {
+    _data = nullptr;
+    _size = 0;
+    return;
+  }
+  madvise(_data, _size, MADV_SEQUENTIAL);
+  _ok = true;
+}
+
+MappedFile::~MappedFile() {
+  if (_data)
+    munmap(_data, _size);
+}
+
+// Inputs smaller than this are not worth splitting between threads.
+static const size_t kMinParallelBytes = 1 << 20;
+
+static bool isLine(std::string_view line, char number) {
+  return line.size() >= 69 && line[0] == number && line[1] == ' ';
+}
+
+TleStreamParser::TleStreamParser(const std::string &source,
+                                 std::vector<TleRecord> &tles,
+                                 size_t firstLine)
+    : _source(source), _tles(tles), _lineNo(firstLine - 1), _line1No(0),
+      _nameSize(0) {}
+
+// Parse one line, without its line ending.
+void TleStreamParser::parseLine(std::string_view line) {
+  ++_lineNo;
+  if (!line.empty() && line.back() == '\r')
+    line.remove_suffix(1);
+
+  if (_line1No) {
+    if (isLine(line, '2')) {
+      TleRecord rec;
+      if (TleRecord::parse(std::string_view(_name, _nameSize),
+                           std::string_view(_line1, TleRecord::kLineSize),
+                           line, rec))
+        _tles.push_back(rec);
+      else
+        std::cerr << "[-] Skipping invalid TLE at line " << _line1No
+                  << " in " << _source << std::endl;
+      _line1No = 0;
+      _nameSize = 0;
+      return;
+    }
+    // Not line 2 of this record, so it starts afresh.
+    std::cerr << "[-] Expected TLE line 2 after line " << _line1No << " in "
+              << _source << std::endl;
+    _line1No = 0;
+    _nameSize = 0;
+  }
+
+  if (isLine(line, '1')) {
+    std::copy_n(line.data(), TleRecord::kLineSize, _line1);
+    _line1No = _lineNo;
+    return;
+  }
+
+  // Trim trailing whitespace from name.
+  const auto en = line.find_last_not_of(" \t");
+  _nameSize = en == std::string_view::npos
+                  ? 0
+                  : std::min(en + 1, TleRecord::kNameSize);
+  std::copy_n(line.data(), _nameSize, _name);
+}
+
+void TleStreamParser::feed(std::string_view data) {
+  size_t pos = 0;
+  if (!_partial.empty()) {
+    const size_t nl = data.find('\n');
+    if (nl == std::string_view::npos) {
+      _partial.append(data);
+      return;
+    }
+    _partial.append(data.substr(0, nl));
+    parseLine(_partial);
+    _partial.clear();
+    pos = nl + 1;
+  }
+
+  // Complete lines are parsed directly from 'data'.
+  size_t nl;
+  while ((nl = data.find('\n', pos)) != std::string_view::npos) {
+    parseLine(data.substr(pos, nl - pos));
+    pos = nl + 1;
+  }
+  _partial.append(data.substr(pos));
+}
+
+void TleStreamParser::finish() {
+  if (!_partial.empty()) {
+    parseLine(_partial);
+    _partial.clear();
+  }
+  if (_line1No) {
+    std::cerr << "[-] Expected TLE line 2 after line " << _line1No << " in "
+              << _source << std::endl;
+    _line1No = 0;
+  }
+}
+
+// Parse 'text', whose first line is line 'firstLine' of 'source'.
+static size_t parseChunk(std::string_view text, const std::string &source,
+                         size_t firstLine, std::vector<TleRecord> &tles) {
+  const size_t before = tles.size();
+  TleStreamParser parser(source, tles, firstLine);
+  parser.feed(text);
+  parser.finish();
+  return tles.size() - before;
+}
+
+size_t parseTLEs(std::string_view text, const std::string &source,
+                 std::vector<TleRecord> &tles) {
+  return parseChunk(text, source, 1, tles);
+}
+
+// Return the first record boundary at or after 'from': the start of the line
+// after a line 2 that directly follows its line 1 (same catalog number).
+// The sequential parser always reads such a pair as one record and then
+// starts afresh, so parsing can be split there without changing the result.
+static size_t findBoundary(std::string_view text, size_t from) {
+  size_t pos = from == 0 ? 0 : text.find('\n', from - 1);
+  if (pos == std::string_view::npos)
+    return text.size();
+  pos += from == 0 ? 0 : 1;
+  std::string_view prev;
+  while (pos < text.size()) {
+    size_t nl = text.find('\n', pos);
+    if (nl == std::string_view::npos)
+      nl = text.size();
+    std::string_view line = text.substr(pos, nl - pos);
+    if (!line.empty() && line.back() == '\r')
+      line.remove_suffix(1);
+    pos = std::min(nl + 1, text.size());
+    if (isLine(prev, '1') && isLine(line, '2') &&
+        prev.substr(2, 5) == line.substr(2, 5))
+      return pos;
+    prev = line;
+  }
+  return text.size();
+}
+
+size_t parseTLEs(std::string_view text, const std::string &source,
+                 std::vector<TleRecord> &tles, ThreadPool &pool) {
+  const size_t nChunks = pool.size();
+  if (nChunks == 1 || text.size() < kMinParallelBytes)
+    return parseTLEs(text, source, tles);
+
+  // Chunk i is [bounds[i], bounds[i + 1]).
+  std::vector<size_t> bounds(nChunks + 1, text.size());
+  bounds[0] = 0;
+  for (size_t i = 1; i < nChunks; ++i)
+    bounds[i] = std::max(bounds[i - 1],
+                         findBoundary(text, text.size() * i / nChunks));
+
+  // Count the lines in each chunk, so messages report the right line.
+  std::vector<size_t> firstLine(nChunks, 0);
+  pool.parallelFor(nChunks, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i)
+      firstLine[i] = std::count(text.begin() + bounds[i],
+                                text.begin() + bounds[i + 1], '\n');
+  });
+  size_t line = 1;
+  for (auto &first : firstLine) {
+    const size_t lines = first;
+    first = line;
+    line += lines;
+  }
+
+  std::vector<std::vector<TleRecord>> chunks(nChunks);
+  pool.parallelFor(nChunks, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i)
+      parseChunk(text.substr(bounds[i], bounds[i + 1] - bounds[i]), source,
+                 firstLine[i], chunks[i]);
+  });
+
+  const size_t before = tles.size();
+  for (auto &chunk : chunks)
+    tles.insert(tles.end(), chunk.begin(), chunk.end());
+  return tles.size() - before;
+}
@@ -0,0 +1,94 @@
+// satnow: tleparser.hh
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __SATNOW_TLEPARSER_HH
+#define __SATNOW_TLEPARSER_HH
+#include "threadpool.hh"
+#include "tlerecord.hh"
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A read-only memory mapping of a whole file.
+class MappedFile {
+private:
+  void *_data;
+  size_t _size;
+  bool _ok;
+  void map(int fd);
+
+public:
+  explicit MappedFile(const std::string &path);
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  bool ok() const { return _ok; }
+  std::string_view view() const {
+    return std::string_view(static_cast<const char *>(_data), _size);
+  }
+};
+
+// Parses TLE records from text that arrives in pieces, such as a download.
+// Records are appended to 'tles' as soon as their last line is complete, and
+// a partial line is held until the rest of it arrives. This is the parser
+// behind parseTLEs(), so the records are the same as parsing the whole text.
+class TleStreamParser {
+private:
+  std::string _source;
+  std::vector<TleRecord> &_tles;
+  std::string _partial;  // Incomplete last line.
+  size_t _lineNo;        // Number of the last line parsed.
+  size_t _line1No;       // Line number of _line1, or 0 if there is none.
+  size_t _nameSize;
+  char _name[TleRecord::kNameSize]; // Name for the next record.
+  char _line1[TleRecord::kLineSize]; // Line 1 waiting for its line 2.
+
+  void parseLine(std::string_view line);
+
+public:
+  // 'source' is only used in messages. 'firstLine' is the line number of the
+  // first line fed.
+  TleStreamParser(const std::string &source, std::vector<TleRecord> &tles,
+                  size_t firstLine = 1);
+
+  // Parse the complete lines in 'data' (plus any partial line before it).
+  void feed(std::string_view data);
+
+  // Parse what is left at the end of the input.
+  void finish();
+};
+
+// Parse the TLE records in 'text' and append them to 'tles'. Returns the
+// number of records appended. 'source' is only used in messages.
+//
+// Both forms of TLE are accepted: the two 69 byte data lines, optionally
+// preceded by a name line (Celestrak and wikipedia say that names are 24
+// bytes, libsgp4 says 22, so names are cut to 22). Lines are scanned in place
+// as views of 'text' and copied straight into TleRecords, so nothing is
+// allocated per line. Records that libsgp4 would reject are reported and
+// skipped.
+size_t parseTLEs(std::string_view text, const std::string &source,
+                 std::vector<TleRecord> &tles);
+
+// As above, but large inputs are split at record boundaries and the pieces
+// are parsed concurrently on 'pool'. The records (and their order) are the
+// same as parsing sequentially.
+size_t parseTLEs(std::string_view text, const std::string &source,
+                 std::vector<TleRecord> &tles, ThreadPool &pool);
+
+#endif // __SATNOW_TLEPARSER_HH
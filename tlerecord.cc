@@ -0,0 +1,145 @@
+// satnow: tlerecord.cc
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tlerecord.hh"
+#include <DateTime.h>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+// The fields below follow libsgp4's Tle::Initialize(), with the same column
+// positions and the same checks on what each field may contain.
+
+// An unsigned integer, optionally right aligned with leading spaces.
+// A blank field is 0.
+static bool parseInt(std::string_view field, unsigned &out) {
+  bool digits = false;
+  unsigned value = 0;
+  for (const char c : field) {
+    if (std::isdigit(static_cast<unsigned char>(c))) {
+      digits = true;
+      value = value * 10 + (c - '0');
+    } else if (digits || c != ' ')
+      return false;
+  }
+  out = value;
+  return true;
+}
+
+// A number with its decimal point at 'point', e.g., "  51.6433" (point 3) or
+// "-.00001264" (point 1). The integer part may have a sign and leading
+// spaces; the fraction must be all digits.
+static bool parseDouble(std::string_view field, size_t point, double &out) {
+  char buf[32];
+  size_t n = 0;
+  if (field.size() >= sizeof(buf) - 1 || field.size() <= point ||
+      field[point] != '.')
+    return false;
+  bool digits = false;
+  for (size_t i = 0; i < point; ++i) {
+    const char c = field[i];
+    if (i == 0 && (c == '-' || c == '+'))
+      buf[n++] = c;
+    else if (std::isdigit(static_cast<unsigned char>(c))) {
+      digits = true;
+      buf[n++] = c;
+    } else if (digits || c != ' ')
+      return false;
+  }
+  if (!digits)
+    buf[n++] = '0';
+  for (size_t i = point; i < field.size(); ++i) {
+    if (i > point && !std::isdigit(static_cast<unsigned char>(field[i])))
+      return false;
+    buf[n++] = field[i];
+  }
+  buf[n] = '\0';
+  out = std::strtod(buf, nullptr);
+  return true;
+}
+
+// Digits with an implied leading decimal point, e.g., eccentricity.
+static bool parseDecimal(std::string_view field, double &out) {
+  double value = 0.0;
+  for (const char c : field) {
+    if (!std::isdigit(static_cast<unsigned char>(c)))
+      return false;
+    value = value * 10.0 + (c - '0');
+  }
+  out = value * std::pow(10.0, -static_cast<double>(field.size()));
+  return true;
+}
+
+// An implied decimal with an exponent, e.g., " 27213-4" is 0.27213e-4.
+static bool parseExponent(std::string_view field, double &out) {
+  if (field.size() < 3)
+    return false;
+  const char sign = field[0];
+  const char expSign = field[field.size() - 2];
+  const char expDigit = field[field.size() - 1];
+  if ((sign != ' ' && sign != '-' && sign != '+') ||
+      (expSign != '-' && expSign != '+') ||
+      !std::isdigit(static_cast<unsigned char>(expDigit)))
+    return false;
+  double mantissa;
+  if (!parseDecimal(field.substr(1, field.size() - 3), mantissa))
+    return false;
+  const int exponent = (expDigit - '0') * (expSign == '-' ? -1 : 1);
+  out = (sign == '-' ? -mantissa : mantissa) * std::pow(10.0, exponent);
+  return true;
+}
+
+bool TleRecord::parse(std::string_view name, std::string_view line1,
+                      std::string_view line2, TleRecord &rec) {
+  if (line1.size() < kLineSize || line2.size() < kLineSize ||
+      line1.substr(0, 2) != "1 " || line2.substr(0, 2) != "2 ")
+    return false;
+  line1 = line1.substr(0, kLineSize);
+  line2 = line2.substr(0, kLineSize);
+  name = name.substr(0, kNameSize);
+
+  unsigned norad1, norad2, year;
+  double day, unused;
+  if (!parseInt(line1.substr(2, 5), norad1) ||
+      !parseInt(line2.substr(2, 5), norad2) || norad1 != norad2 ||
+      !parseInt(line1.substr(18, 2), year) ||
+      !parseDouble(line1.substr(20, 12), 3, day) ||
+      !parseDouble(line1.substr(33, 10), 1, unused) ||
+      !parseExponent(line1.substr(44, 8), unused) ||
+      !parseExponent(line1.substr(53, 8), rec.bstar) ||
+      !parseDouble(line2.substr(8, 8), 3, rec.inclination) ||
+      !parseDouble(line2.substr(17, 8), 3, rec.ascendingNode) ||
+      !parseDecimal(line2.substr(26, 7), rec.eccentricity) ||
+      !parseDouble(line2.substr(34, 8), 3, rec.argPerigee) ||
+      !parseDouble(line2.substr(43, 8), 3, rec.meanAnomaly) ||
+      !parseDouble(line2.substr(52, 11), 2, rec.meanMotion) ||
+      !parseInt(line2.substr(63, 5), norad2))
+    return false;
+
+  // Like libsgp4, fall back to the catalog number for a missing name.
+  if (name.empty())
+    name = line1.substr(2, 5);
+  rec.norad = norad1;
+  rec.epoch = DateTime(year < 57 ? year + 2000 : year + 1900, day).Ticks();
+  std::memcpy(rec.name, name.data(), name.size());
+  rec.name[name.size()] = '\0';
+  std::memcpy(rec.line1, line1.data(), kLineSize);
+  rec.line1[kLineSize] = '\0';
+  std::memcpy(rec.line2, line2.data(), kLineSize);
+  rec.line2[kLineSize] = '\0';
+  return true;
+}
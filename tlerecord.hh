@@ -0,0 +1,63 @@
+// satnow: tlerecord.hh
+//
+// Copyright 2019 Matt Davis (https://github.com/enferex)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __SATNOW_TLERECORD_HH
+#define __SATNOW_TLERECORD_HH
+#include <Tle.h>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+// A TLE in a compact, trivially copyable form.
+//
+// libsgp4's Tle keeps three heap allocated strings plus every parsed field.
+// Catalogs are loaded, stored, and passed around as TleRecords instead, and
+// are only converted to a Tle where libsgp4 needs one (to build a propagator,
+// or to show the full details of a satellite). The elements that satnow uses
+// itself are parsed once, up front.
+struct TleRecord {
+  static constexpr size_t kNameSize = 22; // libsgp4's limit.
+  static constexpr size_t kLineSize = 69;
+
+  // NUL terminated, so they can be printed directly.
+  char name[kNameSize + 1];
+  char line1[kLineSize + 1];
+  char line2[kLineSize + 1];
+
+  uint32_t norad;
+  int64_t epoch;      // DateTime ticks.
+  double inclination; // Degrees.
+  double ascendingNode;
+  double eccentricity;
+  double argPerigee;
+  double meanAnomaly;
+  double meanMotion; // Revolutions per day.
+  double bstar;
+
+  // Fill 'rec' from a name (cut to kNameSize) and the two data lines (cut to
+  // kLineSize). Returns false if the lines would not be accepted by libsgp4,
+  // so toTle() can't throw for a record that parsed.
+  static bool parse(std::string_view name, std::string_view line1,
+                    std::string_view line2, TleRecord &rec);
+
+  Tle toTle() const { return Tle(name, line1, line2); }
+};
+
+static_assert(std::is_trivially_copyable<TleRecord>::value,
+              "TleRecord must be trivially copyable.");
+
+#endif // __SATNOW_TLERECORD_HH